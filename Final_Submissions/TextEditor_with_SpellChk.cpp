@@ -1,19 +1,739 @@
 #include <iostream>
-#include <stack>
+#include <string>
 #include <vector>
+#ifdef _WIN32
 #include <conio.h>      // For _getch() and _kbhit()
 #include <windows.h>    // For SetConsoleCursorPosition()
+#endif
 #include <fstream>
 #include <cctype>       // For isspace() and toupper()
 #include <unordered_map>
 #include <algorithm>
 #include<sstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <deque>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <iterator>
+#include <thread>       // For the background saver
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <future>       // For counting an opened file in the background
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>  // SSE2/AVX2 for countText()
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>   // For mmap() of opened files
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>    // For raw keyboard input
+#include <poll.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
 using namespace std;
 
-const int MAX_UNDO_SIZE = 100; // Set a limit for the undo stack size
+const int UNDO_RING_CAPACITY = 4096; // Slots in the undo history ring buffer
+const size_t DEFAULT_UNDO_BUDGET = 8 << 20; // Bytes of undo history kept (--undo-budget=BYTES)
+const size_t JOURNAL_COMPACT_BYTES = 1 << 20; // Journal size that triggers a rewrite of the document
+const size_t CHECKPOINT_WINDOW = 4096; // Bytes before an in-place patch that identify the file it belongs to
+const int DEFAULT_SAVE_INTERVAL_MS = 200; // How often the saver writes queued edits (--save-interval=MS)
+const int FSYNC_ON_IDLE = 0;  // --fsync=idle: force the journal to disk when typing pauses
+const int FSYNC_ON_EXIT = -1; // --fsync=exit: only when the editor closes; --fsync=N: every N seconds
+const size_t MIN_COUNT_SLICE = 16 << 20; // Smallest part of a text worth its own counting thread
 const int DEFAULT_COLOR = 7; // Default console color
 const int SUGGESTION_COLOR = 10; // Green color for suggestions
 
+//Console starts
+// The editor talks to the console through the Windows console API. Elsewhere
+// the same calls are provided on top of termios and ANSI escape sequences,
+// and keys are translated to the codes _getch() returns on Windows.
+#ifdef _WIN32
+// Blank the whole console buffer and home the cursor, without a cls process
+void clearScreen() {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    cout.flush();
+    if (!GetConsoleScreenBufferInfo(out, &info)) return;
+    COORD home = {0, 0};
+    DWORD cells = info.dwSize.X * info.dwSize.Y, written;
+    FillConsoleOutputCharacterA(out, ' ', cells, home, &written);
+    FillConsoleOutputAttribute(out, info.wAttributes, cells, home, &written);
+    SetConsoleCursorPosition(out, home);
+}
+
+// Blank the console row from the cursor to its right edge
+void clearToLineEnd() {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    cout.flush();
+    if (!GetConsoleScreenBufferInfo(out, &info)) return;
+    DWORD cells = info.dwSize.X - info.dwCursorPosition.X, written;
+    FillConsoleOutputCharacterA(out, ' ', cells, info.dwCursorPosition, &written);
+    FillConsoleOutputAttribute(out, info.wAttributes, cells, info.dwCursorPosition, &written);
+}
+
+// Move console rows top..bottom up by count (down if negative), blanking
+// the rows that scroll in
+void scrollRows(int top, int bottom, int count) {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    cout.flush();
+    if (!GetConsoleScreenBufferInfo(out, &info)) return;
+    SMALL_RECT area = {0, (SHORT)top, (SHORT)(info.dwSize.X - 1), (SHORT)bottom};
+    COORD to = {0, (SHORT)(top - count)};
+    CHAR_INFO fill;
+    fill.Char.AsciiChar = ' ';
+    fill.Attributes = info.wAttributes;
+    ScrollConsoleScreenBufferA(out, &area, &area, to, &fill);
+}
+
+// Rows and columns of the visible console window
+void consoleSize(int& rows, int& cols) {
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    rows = 25;
+    cols = 80;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+        rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+        cols = info.srWindow.Right - info.srWindow.Left + 1;
+    }
+}
+#else
+typedef int HANDLE;
+const HANDLE STD_OUTPUT_HANDLE = 1;
+struct COORD { short X, Y; };
+
+HANDLE GetStdHandle(HANDLE handle) { return handle; }
+
+void SetConsoleCursorPosition(HANDLE, COORD coord) {
+    cout << "\x1b[" << coord.Y + 1 << ';' << coord.X + 1 << 'H' << flush;
+}
+
+// Console attributes are intensity, red, green, blue from the high bit down;
+// ANSI colour numbers have red in the low bit
+int ansiColor(int attribute) {
+    int ansi = ((attribute & 1) << 2) | (attribute & 2) | ((attribute & 4) >> 2);
+    return ((attribute & 8) ? 90 : 30) + ansi;
+}
+
+void SetConsoleTextAttribute(HANDLE, int attribute) {
+    cout << "\x1b[" << ansiColor(attribute) << 'm' << flush;
+}
+
+void clearScreen() { cout << "\x1b[2J\x1b[H"; }
+
+void clearToLineEnd() { cout << "\x1b[K"; }
+
+// Scroll inside a region set with DECSTBM, then give the whole screen back
+void scrollRows(int top, int bottom, int count) {
+    cout << "\x1b[" << top + 1 << ';' << bottom + 1 << 'r';
+    if (count > 0) cout << "\x1b[" << count << 'S';
+    else cout << "\x1b[" << -count << 'T';
+    cout << "\x1b[r";
+}
+
+void consoleSize(int& rows, int& cols) {
+    winsize size;
+    rows = 25;
+    cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0) {
+        rows = size.ws_row;
+        cols = size.ws_col;
+    }
+}
+
+// Keyboard in raw mode (no echo, no line editing, Ctrl keys as characters)
+// for as long as the editor runs
+class RawKeyboard {
+private:
+    termios saved;
+    bool raw = false;
+
+public:
+    RawKeyboard() {
+        if (tcgetattr(STDIN_FILENO, &saved) != 0) return; // Not a terminal (input is piped)
+        termios t = saved;
+        t.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        t.c_iflag &= ~(IXON | ICRNL);
+        t.c_cc[VMIN] = 1;
+        t.c_cc[VTIME] = 0;
+        raw = tcsetattr(STDIN_FILENO, TCSANOW, &t) == 0;
+    }
+    ~RawKeyboard() { if (raw) tcsetattr(STDIN_FILENO, TCSANOW, &saved); }
+
+    bool ready(int timeoutMs) {
+        pollfd p = {STDIN_FILENO, POLLIN, 0};
+        return poll(&p, 1, timeoutMs) > 0;
+    }
+
+    // Next byte of input, -1 at the end of input
+    int next() {
+        unsigned char c;
+        ssize_t n;
+        while ((n = read(STDIN_FILENO, &c, 1)) < 0 && errno == EINTR) {}
+        return n == 1 ? c : -1;
+    }
+};
+
+RawKeyboard& keyboard() {
+    static RawKeyboard k;
+    return k;
+}
+
+deque<int> pendingKeys; // Translated codes not returned by _getch() yet
+
+// Is a key waiting? Waits a few milliseconds so the editor loop does not spin
+int _kbhit() { return !pendingKeys.empty() || keyboard().ready(10); }
+
+int _getch() {
+    if (!pendingKeys.empty()) {
+        int key = pendingKeys.front();
+        pendingKeys.pop_front();
+        return key;
+    }
+    int c = keyboard().next();
+    if (c < 0) return 27;       // End of input closes the editor like ESC
+    if (c == 127) return 8;     // Backspace
+    if (c == '\n') return 13;   // Enter
+    if (c != 27 || !keyboard().ready(20)) return c; // A key, or ESC on its own
+    // Arrow keys send ESC [ A..D, Delete ESC [ 3 ~
+    if (keyboard().next() != '[') return 27;
+    int code = 0;
+    switch (keyboard().next()) {
+        case 'A': code = 72; break;
+        case 'B': code = 80; break;
+        case 'C': code = 77; break;
+        case 'D': code = 75; break;
+        case '3': keyboard().next(); code = 83; break;
+    }
+    if (code == 0) return 27;
+    pendingKeys.push_back(code);
+    return 224;
+}
+#endif
+//Console ends
+
+//Screen buffer starts
+// Output of one frame. Outside Windows everything (text, cursor moves,
+// colours, scrolling) is collected as escape sequences in one buffer that
+// is kept from frame to frame, and send() hands it to the terminal with a
+// single write(), so a frame costs one system call and, once the buffer has
+// grown to fit a frame, no allocation. The Windows console is driven
+// through its API, with the text between two calls written in one go.
+class FrameWriter {
+private:
+    string bytes;
+    static const size_t INITIAL_SIZE = 64 << 10;
+
+#ifdef _WIN32
+    void writeText() {
+        if (bytes.empty()) return;
+        cout.write(bytes.data(), bytes.size());
+        cout.flush();
+        bytes.clear();
+    }
+#else
+    void number(int n) {
+        char digits[12];
+        int len = 0;
+        do {
+            digits[len++] = '0' + n % 10;
+            n /= 10;
+        } while (n > 0);
+        while (len > 0) bytes += digits[--len];
+    }
+
+    // ESC [ a ; b  or  ESC [ a, then the command letter
+    void sequence(int a, int b, char command) {
+        bytes += "\x1b[";
+        if (a >= 0) number(a);
+        if (b >= 0) {
+            bytes += ';';
+            number(b);
+        }
+        bytes += command;
+    }
+#endif
+
+public:
+    FrameWriter() { bytes.reserve(INITIAL_SIZE); }
+
+    void text(const char* data, size_t len) { bytes.append(data, len); }
+
+    void moveTo(int row, int col) {
+#ifdef _WIN32
+        writeText();
+        COORD coord;
+        coord.X = col;
+        coord.Y = row;
+        SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), coord);
+#else
+        sequence(row + 1, col + 1, 'H');
+#endif
+    }
+
+    void color(int attribute) {
+#ifdef _WIN32
+        writeText();
+        SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), attribute);
+#else
+        sequence(ansiColor(attribute), -1, 'm');
+#endif
+    }
+
+    void clearLine() {
+#ifdef _WIN32
+        writeText();
+        clearToLineEnd();
+#else
+        sequence(-1, -1, 'K');
+#endif
+    }
+
+    void clearAll() {
+#ifdef _WIN32
+        writeText();
+        clearScreen();
+#else
+        bytes += "\x1b[2J\x1b[H";
+#endif
+    }
+
+    // Rows top..bottom move up by count (down if negative)
+    void scroll(int top, int bottom, int count) {
+#ifdef _WIN32
+        writeText();
+        scrollRows(top, bottom, count);
+#else
+        sequence(top + 1, bottom + 1, 'r');
+        sequence(abs(count), -1, count > 0 ? 'S' : 'T');
+        sequence(-1, -1, 'r');
+#endif
+    }
+
+    // Send the frame to the console
+    void send() {
+#ifdef _WIN32
+        writeText();
+#else
+        cout.flush(); // Anything printed before the frame goes first
+        size_t done = 0;
+        while (done < bytes.size()) {
+            ssize_t n = ::write(STDOUT_FILENO, bytes.data() + done, bytes.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        bytes.clear(); // Keeps its capacity for the next frame
+#endif
+    }
+};
+
+// What the console shows, kept as a grid of cells (character plus colour
+// attribute) twice: 'front' is what is on the screen, 'back' the frame being
+// drawn. present() compares the two and writes only the cells that differ,
+// moving the cursor only across unchanged stretches and changing the colour
+// only where the attribute changes, so showing or hiding an overlay such as
+// the autocomplete hint costs just the cells it covers.
+class ScreenBuffer {
+public:
+    struct Cell {
+        char ch;
+        unsigned char attr;
+    };
+
+private:
+    int rows = 0, cols = 0;
+    vector<Cell> front, back;
+    vector<char> dirty;         // Rows of 'back' changed since the last present()
+    int attr = -1;              // Attribute the console has, -1 if unknown
+    int atRow = -1, atCol = -1; // Where the console cursor is after our output, -1 if unknown
+    FrameWriter out;            // Output of the frame being presented
+
+    // Equal cells need no output; blanks only differ in their background
+    static bool same(const Cell& a, const Cell& b) {
+        if (a.ch == ' ' && b.ch == ' ') return (a.attr & 0xF0) == (b.attr & 0xF0);
+        return a.ch == b.ch && a.attr == b.attr;
+    }
+
+    void moveTo(int row, int col) {
+        if (row == atRow && col == atCol) return;
+        out.moveTo(row, col);
+        atRow = row;
+        atCol = col;
+    }
+
+    void writeCell(const Cell& cell) {
+        if (cell.attr != attr && !(cell.ch == ' ' && attr >= 0 && (cell.attr & 0xF0) == (attr & 0xF0))) {
+            setAttribute(cell.attr);
+        }
+        out.text(&cell.ch, 1);
+        atCol++;
+    }
+
+    // Write the differences between back and front in one row
+    void presentRow(int row) {
+        Cell* b = &back[row * cols];
+        Cell* f = &front[row * cols];
+        int blankFrom = cols; // Everything from here on is blank in the new row
+        while (blankFrom > 0 && b[blankFrom - 1].ch == ' ' && (b[blankFrom - 1].attr & 0xF0) == (b[cols - 1].attr & 0xF0)) blankFrom--;
+        for (int col = 0; col < cols; col++) {
+            if (same(b[col], f[col])) continue;
+            if (col >= blankFrom && attr >= 0 && (attr & 0xF0) == (b[col].attr & 0xF0)) {
+                moveTo(row, col); // Blank the rest of the row in one go
+                out.clearLine();
+                for (int c = col; c < cols; c++) f[c] = b[c];
+                return;
+            }
+            // Rewrite a short unchanged stretch in the current colour rather
+            // than move over it
+            if (row == atRow && atCol < col && col - atCol <= 4) {
+                bool plain = true;
+                for (int c = atCol; c < col; c++) plain = plain && same(f[c], Cell{f[c].ch, (unsigned char)attr});
+                if (plain) {
+                    for (int c = atCol; c < col; c++) writeCell(f[c]);
+                }
+            }
+            moveTo(row, col);
+            writeCell(b[col]);
+            f[col] = b[col];
+        }
+    }
+
+public:
+    // Match the console size. On a change everything is cleared and
+    // returns true; the next frame then has to draw every row.
+    bool resize(int newRows, int newCols, int fill) {
+        if (newRows == rows && newCols == cols) return false;
+        rows = newRows;
+        cols = newCols;
+        setAttribute(fill);
+        out.clearAll();
+        front.assign((size_t)rows * cols, Cell{' ', (unsigned char)fill});
+        back = front;
+        dirty.assign(rows, 0);
+        atRow = atCol = 0;
+        return true;
+    }
+
+    // Set the console's colour attribute, for the cells and for anyone else.
+    // It is sent with the next frame.
+    void setAttribute(int color) {
+        if (color == attr) return;
+        out.color(color);
+        attr = color;
+    }
+
+    // Scroll rows top..bottom up by count (down if negative) on the console
+    // and in both frames, so rows that only moved need no output. The rows
+    // that scroll in are blank and have to be drawn.
+    void scroll(int top, int bottom, int count, int fill) {
+        if (count == 0 || top < 0 || bottom >= rows || top > bottom) return;
+        setAttribute(fill);
+        out.scroll(top, bottom, count);
+        atRow = atCol = -1;
+        size_t first = (size_t)top * cols, end = (size_t)(bottom + 1) * cols;
+        size_t shift = (size_t)min(abs(count), bottom - top + 1) * cols;
+        for (vector<Cell>* grid : {&front, &back}) {
+            if (count > 0) {
+                move(grid->begin() + first + shift, grid->begin() + end, grid->begin() + first);
+                fill_n(grid->begin() + end - shift, shift, Cell{' ', (unsigned char)fill});
+            } else {
+                move_backward(grid->begin() + first, grid->begin() + end - shift, grid->begin() + end);
+                fill_n(grid->begin() + first, shift, Cell{' ', (unsigned char)fill});
+            }
+        }
+        for (int row = top; row <= bottom; row++) dirty[row] = 0;
+    }
+
+    // Blank a row of the next frame
+    void clearRow(int row, int fill) {
+        if (row < 0 || row >= rows) return;
+        fill_n(&back[row * cols], cols, Cell{' ', (unsigned char)fill});
+        dirty[row] = 1;
+    }
+
+    // Put text in the next frame at (row, col), cut at the last column but
+    // one (writing the last column would wrap). Returns the column after it.
+    int put(int row, int col, const char* data, size_t len, int color) {
+        if (row < 0 || row >= rows) return col;
+        Cell* cells = &back[row * cols];
+        for (size_t i = 0; i < len && col < cols - 1; i++) cells[col++] = Cell{data[i], (unsigned char)color};
+        dirty[row] = 1;
+        return col;
+    }
+
+    // Bring the console up to date with the frame and place the cursor, all
+    // in one write
+    void present(int cursorRow, int cursorCol) {
+        for (int row = 0; row < rows; row++) {
+            if (!dirty[row]) continue;
+            presentRow(row);
+            dirty[row] = 0;
+        }
+        moveTo(cursorRow, cursorCol);
+        out.send();
+        atRow = atCol = -1; // The caller may move the cursor itself
+    }
+};
+
+// The part of the document on the screen: 'height' lines from line 'top'
+// and 'width' columns from column 'left'. Only these are ever drawn.
+struct Viewport {
+    int top = 0, left = 0;
+    int height = 1, width = 1;
+
+    // Scroll so that (line, column) is on the screen. Vertically by as little
+    // as possible, so moving a line past the edge scrolls by one; sideways by
+    // a good part of the width, so typing at the edge does not shift every
+    // row on each key.
+    void follow(int line, int column) {
+        if (line < top) top = line;
+        if (line >= top + height) top = line - height + 1;
+        if (column < left) left = max(0, column - width / 4);
+        if (column >= left + width) left = column - width * 3 / 4;
+    }
+};
+//Screen buffer ends
+
+//Async file I/O starts
+#ifndef _WIN32
+// Positional reads and writes that run while the caller goes on: queue
+// requests, then wait() for all of them. Large requests are split into
+// CHUNK_SIZE pieces with up to QUEUE_DEPTH in flight at once. On Linux they
+// are submitted through io_uring (raw system calls, no liburing needed);
+// where io_uring is missing or not allowed each piece runs on its own thread
+// with pread/pwrite instead.
+class AsyncIO {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 8;
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+private:
+    struct Request {
+        int fd;
+        iovec io;               // Part of the buffer still to transfer
+        uint64_t offset;
+        bool isWrite;
+    };
+    deque<Request> requests;    // Queued since the last wait(), by id. Only the caller's thread
+                                // touches it; elements keep their address (the ring points at them)
+    atomic<bool> failed{false};
+    deque<thread> workers;      // Fallback: one thread per request in flight
+
+#ifdef __linux__
+    int ringFd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+    unsigned *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+    io_uring_cqe* cqes;
+    unsigned inFlight = 0;
+
+    bool setupRing() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params);
+        if (ringFd < 0) return false;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == (io_uring_sqe*)MAP_FAILED) {
+            closeRing();
+            return false;
+        }
+        char* sq = (char*)sqRing;
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+        char* cq = (char*)cqRing;
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void closeRing() {
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+        if (sqes != (io_uring_sqe*)MAP_FAILED) munmap(sqes, sqesSize);
+        sqRing = cqRing = MAP_FAILED;
+        sqes = (io_uring_sqe*)MAP_FAILED;
+        if (ringFd >= 0) ::close(ringFd);
+        ringFd = -1;
+    }
+
+    // Put request 'id' on the submission ring and tell the kernel
+    void submit(size_t id) {
+        const Request& r = requests[id];
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = r.isWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = r.fd;
+        sqe->addr = (uint64_t)(uintptr_t)&r.io;
+        sqe->len = 1;
+        sqe->off = r.offset;
+        sqe->user_data = id;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        inFlight++;
+        if (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, NULL, 0) < 0) {
+            failed = true;
+            inFlight--;
+        }
+    }
+
+    // Wait for at least one completion and handle all that are there;
+    // short transfers are submitted again for the rest
+    void reap() {
+        unsigned head = *cqHead;
+        while (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            if (syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                failed = true;
+                inFlight = 0;
+                return;
+            }
+        }
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            size_t id = cqe.user_data;
+            int res = cqe.res;
+            __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+            inFlight--;
+            Request& r = requests[id];
+            if (res == -EINTR || res == -EAGAIN) {
+                submit(id);
+            } else if (res <= 0) {
+                failed = true;
+            } else if ((size_t)res < r.io.iov_len) {
+                r.io.iov_base = (char*)r.io.iov_base + res;
+                r.io.iov_len -= res;
+                r.offset += res;
+                submit(id);
+            }
+        }
+    }
+#endif
+
+    // Fallback: transfer r on the calling thread. The worker gets its own copy
+    // of the request, since 'requests' grows while it runs.
+    void transfer(Request r) {
+        char* data = (char*)r.io.iov_base;
+        size_t done = 0;
+        while (done < r.io.iov_len) {
+            ssize_t n = r.isWrite ? pwrite(r.fd, data + done, r.io.iov_len - done, r.offset + done)
+                                  : pread(r.fd, data + done, r.io.iov_len - done, r.offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                failed = true;
+                return;
+            }
+            done += n;
+        }
+    }
+
+    void queue(int fd, char* data, size_t len, uint64_t offset, bool isWrite) {
+        for (size_t done = 0; done < len; done += CHUNK_SIZE) {
+            size_t n = min(CHUNK_SIZE, len - done);
+            requests.push_back({fd, {data + done, n}, offset + done, isWrite});
+            size_t id = requests.size() - 1;
+#ifdef __linux__
+            if (ringFd >= 0) {
+                while (inFlight >= QUEUE_DEPTH) reap();
+                submit(id);
+                continue;
+            }
+#endif
+            if (workers.size() >= QUEUE_DEPTH) {
+                workers.front().join();
+                workers.pop_front();
+            }
+            workers.emplace_back(&AsyncIO::transfer, this, requests[id]);
+        }
+    }
+
+public:
+    AsyncIO() {
+#ifdef __linux__
+        setupRing();
+#endif
+    }
+
+    ~AsyncIO() {
+        wait();
+#ifdef __linux__
+        closeRing();
+#endif
+    }
+
+    bool usesRing() const {
+#ifdef __linux__
+        return ringFd >= 0;
+#else
+        return false;
+#endif
+    }
+
+    // Queue a read of len bytes at offset into data, or a write from data.
+    // The buffer has to stay untouched until wait() returns.
+    void read(int fd, char* data, size_t len, uint64_t offset) { queue(fd, data, len, offset, false); }
+    void write(int fd, const char* data, size_t len, uint64_t offset) { queue(fd, (char*)data, len, offset, true); }
+
+    // Wait until everything queued is done; false if any of it failed
+    bool wait() {
+#ifdef __linux__
+        while (inFlight > 0) reap();
+#endif
+        for (thread& worker : workers) worker.join();
+        workers.clear();
+        requests.clear();
+        return !failed.exchange(false);
+    }
+};
+#endif
+
+// Read a whole file into data. Large files are read as several chunks in
+// flight at once (see AsyncIO).
+bool readWholeFile(const string& path, string& data) {
+#ifdef _WIN32
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0;
+    if (ok) {
+        data.resize(info.st_size);
+        AsyncIO io;
+        io.read(fd, &data[0], data.size(), 0);
+        ok = io.wait();
+    }
+    ::close(fd);
+    return ok;
+#endif
+}
+//Async file I/O ends
+
 //Spellchecker and recommender code meat starts
 struct TrieNode {
     TrieNode* children[26];
@@ -60,95 +780,2770 @@ public:
             if (node->children[index] == nullptr) {
                 return false;
             }
-            node = node->children[index];
+            node = node->children[index];
+        }
+        return node->isEndOfWord;
+    }
+
+    // Collect suggestions
+    void collectSuggestions(TrieNode* node, string& prefix, vector<string>& suggestions) {
+        if (node->isEndOfWord) {
+            suggestions.push_back(prefix);
+        }
+        for (int i = 0; i < 26 && suggestions.size() < 5; ++i) {  // Stop after 5 suggestions
+            if (node->children[i] != nullptr) {
+                prefix.push_back('a' + i);
+                collectSuggestions(node->children[i], prefix, suggestions);
+                prefix.pop_back();
+            }
+        }
+    }
+
+    // Get suggestions for a word
+    vector<string> getSuggestions(const string& prefix) {
+        TrieNode* node = root;
+        vector<string> suggestions;
+        for (char ch : prefix) {
+            int index = ch - 'a';
+            if (node->children[index] == nullptr) {
+                return suggestions;  // No suggestions found
+            }
+            node = node->children[index];
+        }
+        collectSuggestions(node, const_cast<string&>(prefix), suggestions);
+        return suggestions;
+    }
+};
+
+// Load dictionary into Trie. The file is read in one go (in chunks, see
+// readWholeFile()) and then split into words.
+void loadDictionary(Trie& trie, const string& dictionaryFile) {
+    string data;
+    if (!readWholeFile(dictionaryFile, data)) return;
+    istringstream dictFile(data);
+    string word;
+    while (getline(dictFile, word)) {
+        trie.insert(word);
+    }
+}
+
+// Spell check results are appended here (by the background saver)
+const string SUGGESTIONS_FILE = "C:/Users/sohom/Downloads/DSA-Group-3-main/DSA-Group-3-main/Primary Implementations/suggestions.txt";
+
+// The lines to append to SUGGESTIONS_FILE for word: empty if it is spelled
+// right, else the word and up to 5 suggestions. Only builds the text, so the
+// key press does not wait for the file.
+string spellcheckAndSuggest(Trie& trie, const string& word) {
+    ostringstream outFile;
+    
+    string processedWord = word;
+    // Remove punctuation if any
+    processedWord.erase(remove_if(processedWord.begin(), processedWord.end(), ::ispunct), processedWord.end());
+    transform(processedWord.begin(), processedWord.end(), processedWord.begin(), ::tolower);
+    
+    if (!trie.search(processedWord)) {
+        outFile << processedWord << " Did you mean?\n";
+        vector<string> suggestions = trie.getSuggestions(processedWord.substr(0, 2));  // Use first 2 letters for suggestions
+        int suggestionCount = 0;
+        for (const string& suggestion : suggestions) {
+            outFile << suggestion << " ";
+            if (++suggestionCount >= 5) break;  // Limit to top 5 suggestions
+        }
+        outFile << "\n\n";
+    }
+    
+    return outFile.str();
+}
+
+Trie trie;
+thread dictionaryLoader;    // Fills 'trie' while the editor starts up
+
+void loadDictionaryInBackground(const string& dictionaryFile) {
+    dictionaryLoader = thread(loadDictionary, ref(trie), dictionaryFile);
+}
+
+// Called before the trie is used
+void waitForDictionary() {
+    if (dictionaryLoader.joinable()) dictionaryLoader.join();
+}
+//Spellchecker code meat ends
+
+
+long long int Word_Count = 0;   //Set initial word count as 0
+const vector<int> Colours = {7,9,12,13,14};  //Default : 7(white)
+                                                //Blue : 9
+                                                //Red : 12
+                                                //Magenta : 13
+                                                //Yellow : 14                                                                                               
+auto Colour_Itr = Colours.begin();    //To iterate through colours
+
+//Text buffer API starts
+// Polynomial content hash, h = h * HASH_BASE + (c + 1) for each character
+// (mod 2^64). Hashes of two pieces combine as h(AB) = h(A) * HASH_BASE^|B| + h(B),
+// which lets tree engines keep a hash per subtree.
+const uint64_t HASH_BASE = 1099511628211ULL;
+
+uint64_t hashAppend(uint64_t h, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) h = h * HASH_BASE + (unsigned char)data[i] + 1;
+    return h;
+}
+
+// Read-only access to a text. Positions are byte offsets into the document
+// and lines are kept inline as '\n' characters.
+class TextView {
+public:
+    virtual ~TextView() {}
+
+    virtual size_t size() const = 0;
+    virtual char at(size_t i) const = 0;
+
+    // Calls fn(data, len) for each contiguous run of [from, to), in order
+    virtual void forEachChunk(size_t from, size_t to, const function<void(const char*, size_t)>& fn) const = 0;
+
+    // Copy of the characters in [from, to)
+    string substr(size_t from, size_t to) const {
+        string out;
+        out.reserve(to - from);
+        forEachChunk(from, to, [&](const char* data, size_t len) { out.append(data, len); });
+        return out;
+    }
+
+    // Whole document as one string
+    string text() const { return substr(0, size()); }
+};
+
+// Every document engine exposes the same small API so the editor does not
+// care how the text is stored.
+class TextBuffer : public TextView {
+protected:
+    uint64_t editVersion = 0;   // Bumped by every change to the text, never goes back
+
+public:
+
+    // Edit counter: if it has not moved, the text has not changed (O(1))
+    uint64_t version() const { return editVersion; }
+
+    // Hash of [from, to); equal text gives equal hashes in every engine
+    virtual uint64_t hashRange(size_t from, size_t to) const {
+        uint64_t h = 0;
+        forEachChunk(from, to, [&](const char* data, size_t len) { h = hashAppend(h, data, len); });
+        return h;
+    }
+
+    // Hash of the whole document (O(1) for the rope, which caches it)
+    virtual uint64_t contentHash() const { return hashRange(0, size()); }
+
+    virtual void insert(size_t pos, const string& text) = 0;
+    virtual void erase(size_t pos, size_t len) = 0;
+
+    // Frozen copy of the text that stays valid while this buffer is edited
+    // and may be read on another thread (the saver). Cheap for every engine:
+    // the editor calls it on the input thread.
+    virtual unique_ptr<TextView> snapshot() const = 0;
+
+    // Overwrite one character (engines with direct storage do this in place)
+    virtual void replaceChar(size_t pos, char ch) {
+        erase(pos, 1);
+        insert(pos, string(1, ch));
+    }
+
+    // Replace [pos, pos + len) with text
+    virtual void replace(size_t pos, size_t len, const string& text) {
+        erase(pos, len);
+        insert(pos, text);
+    }
+
+    // Start of the line containing pos
+    virtual size_t lineStart(size_t pos) const {
+        while (pos > 0 && at(pos - 1) != '\n') pos--;
+        return pos;
+    }
+
+    // End of the line containing pos (position of its '\n', or size())
+    virtual size_t lineEnd(size_t pos) const {
+        size_t n = size();
+        while (pos < n && at(pos) != '\n') pos++;
+        return pos;
+    }
+
+    // Number of '\n' characters in [0, to)
+    virtual int countLines(size_t to) const {
+        int count = 0;
+        forEachChunk(0, to, [&](const char* data, size_t len) { count += std::count(data, data + len, '\n'); });
+        return count;
+    }
+
+    // Offset of the first character of line 'line' (0-based), or size() past the last line
+    virtual size_t lineOffset(size_t line) const {
+        size_t pos = 0, n = size();
+        while (line > 0 && pos < n) {
+            if (at(pos++) == '\n') line--;
+        }
+        return line > 0 ? n : pos;
+    }
+};
+//Text buffer API ends
+
+//Line index starts
+// Order-statistics tree (a treap) over the lengths of the document's lines,
+// each length counting the line's '\n'. A subtree caches its line count and
+// total length, so line -> offset and offset -> line are O(log lines), and
+// inserting or deleting a newline splits or joins one node in O(log lines)
+// without shifting the lines after it.
+class LineIndex {
+private:
+    struct Line {
+        size_t len;            // Length of this line including its '\n'
+        size_t sum;            // Total length of the subtree
+        size_t count;          // Lines in the subtree
+        unsigned priority;
+        Line* left = nullptr;
+        Line* right = nullptr;
+    };
+
+    Line* root = nullptr;
+    mt19937 rng;
+
+    static size_t sum(const Line* t) { return t ? t->sum : 0; }
+    static size_t count(const Line* t) { return t ? t->count : 0; }
+    static void update(Line* t) {
+        t->sum = sum(t->left) + t->len + sum(t->right);
+        t->count = count(t->left) + 1 + count(t->right);
+    }
+
+    Line* makeLine(size_t len) {
+        Line* t = new Line();
+        t->len = len;
+        t->priority = rng();
+        update(t);
+        return t;
+    }
+
+    Line* merge(Line* a, Line* b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (a->priority > b->priority) {
+            a->right = merge(a->right, b);
+            update(a);
+            return a;
+        }
+        b->left = merge(a, b->left);
+        update(b);
+        return b;
+    }
+
+    // 'a' gets the first k lines of t, 'b' the rest
+    void split(Line* t, size_t k, Line*& a, Line*& b) {
+        if (!t) { a = b = nullptr; return; }
+        if (k <= count(t->left)) {
+            split(t->left, k, a, t->left);
+            update(t);
+            b = t;
+        } else {
+            split(t->right, k - count(t->left) - 1, t->right, b);
+            update(t);
+            a = t;
+        }
+    }
+
+    void destroy(Line* t) {
+        if (!t) return;
+        destroy(t->left);
+        destroy(t->right);
+        delete t;
+    }
+
+    // Treap over lens with ordinary random priorities, built left to right in
+    // O(lines) by keeping the right spine on a stack. Trees built this way can
+    // be merged with each other and still stay balanced.
+    Line* build(const vector<size_t>& lens) {
+        vector<Line*> spine; // Right spine, root first
+        for (size_t len : lens) {
+            Line* t = makeLine(len);
+            Line* below = nullptr;
+            while (!spine.empty() && spine.back()->priority < t->priority) {
+                below = spine.back();
+                spine.pop_back();
+                update(below);
+            }
+            t->left = below;
+            if (!spine.empty()) spine.back()->right = t;
+            spine.push_back(t);
+        }
+        for (size_t i = spine.size(); i-- > 0;) update(spine[i]);
+        return spine.empty() ? nullptr : spine[0];
+    }
+
+    // Replace lines [first, last] with one line of length len
+    void replaceLines(size_t first, size_t last, const vector<size_t>& lens) {
+        Line *a, *b, *middle, *c;
+        split(root, first, a, b);
+        split(b, last - first + 1, middle, c);
+        destroy(middle);
+        for (size_t len : lens) a = merge(a, makeLine(len));
+        root = merge(a, c);
+    }
+
+    // Length of a single line
+    size_t lengthOf(size_t line) const {
+        const Line* t = root;
+        while (t) {
+            size_t leftCount = count(t->left);
+            if (line < leftCount) {
+                t = t->left;
+            } else if (line == leftCount) {
+                return t->len;
+            } else {
+                line -= leftCount + 1;
+                t = t->right;
+            }
+        }
+        return 0;
+    }
+
+public:
+    // Indexes built separately and later appended must use different seeds
+    explicit LineIndex(unsigned seed = 54321) : rng(seed) { root = makeLine(0); }
+    LineIndex(const LineIndex&) = delete;
+    LineIndex& operator=(const LineIndex&) = delete;
+    ~LineIndex() { destroy(root); }
+
+    // Rebuild from the line lengths of a whole document in O(lines)
+    void assign(const vector<size_t>& lens) {
+        destroy(root);
+        root = lens.empty() ? makeLine(0) : build(lens);
+    }
+
+    // Text added at the end of the document: 'extra' more characters on the
+    // last line, then, if 'rest' is given, its lines after it ('rest' is left
+    // empty). O(log lines).
+    void append(size_t extra, LineIndex* rest) {
+        Line *a, *last;
+        split(root, lineCount() - 1, a, last);
+        last->len += extra;
+        update(last);
+        root = merge(a, last);
+        if (rest) {
+            root = merge(root, rest->root);
+            rest->root = nullptr;
+        }
+    }
+
+    size_t lineCount() const { return count(root); }
+    size_t size() const { return sum(root); }
+
+    // Offset of the first character of 'line'
+    size_t lineOffset(size_t line) const {
+        size_t offset = 0;
+        const Line* t = root;
+        while (t) {
+            size_t leftCount = count(t->left);
+            if (line <= leftCount) {
+                t = t->left;
+            } else {
+                offset += sum(t->left) + t->len;
+                line -= leftCount + 1;
+                t = t->right;
+            }
+        }
+        return offset;
+    }
+
+    // Line containing offset pos (pos == size() belongs to the last line)
+    size_t lineOf(size_t pos) const {
+        size_t line = 0;
+        const Line* t = root;
+        while (t) {
+            if (pos < sum(t->left) + t->len) {
+                if (pos < sum(t->left)) {
+                    t = t->left;
+                } else {
+                    return line + count(t->left);
+                }
+            } else {
+                pos -= sum(t->left) + t->len;
+                line += count(t->left) + 1;
+                t = t->right;
+            }
+        }
+        return min(line, lineCount() - 1);
+    }
+
+    // Account for text inserted at pos, splitting lines at its newlines
+    void insert(size_t pos, const char* text, size_t len) {
+        size_t line = lineOf(pos);
+        size_t offset = pos - lineOffset(line);
+        size_t oldLen = lengthOf(line);
+        vector<size_t> lens;
+        size_t current = offset;
+        for (size_t i = 0; i < len; i++) {
+            current++;
+            if (text[i] == '\n') {
+                lens.push_back(current);
+                current = 0;
+            }
+        }
+        lens.push_back(current + oldLen - offset);
+        replaceLines(line, line, lens);
+    }
+
+    // Account for [pos, pos + len) being erased, joining the lines it spans
+    void erase(size_t pos, size_t len) {
+        if (len == 0) return;
+        size_t first = lineOf(pos), last = lineOf(pos + len);
+        size_t total = lineOffset(last) + lengthOf(last) - lineOffset(first);
+        replaceLines(first, last, vector<size_t>(1, total - len));
+    }
+};
+
+// Line lengths (each including its '\n') of text streamed in chunk by chunk
+class LineScanner {
+public:
+    vector<size_t> lens;
+    size_t current = 0;
+
+    void feed(const char* data, size_t len) {
+        const char* end = data + len;
+        while (data < end) {
+            const char* newline = (const char*)memchr(data, '\n', end - data);
+            if (!newline) {
+                current += end - data;
+                break;
+            }
+            lens.push_back(current + (newline - data) + 1);
+            current = 0;
+            data = newline + 1;
+        }
+    }
+
+    // All lengths, including the last line that has no '\n'
+    vector<size_t> finish() {
+        vector<size_t> all = lens;
+        all.push_back(current);
+        return all;
+    }
+};
+
+// Base for engines that do not count newlines themselves: a LineIndex kept
+// next to the text answers the line queries in O(log lines) instead of scanning.
+// A freshly opened file is indexed by a background thread, in batches the
+// editor merges in as it needs them: a query only waits until the scan has
+// reached the part of the document it asks about.
+class IndexedBuffer : public TextBuffer {
+private:
+    static constexpr size_t SCAN_BATCH = 1 << 20;
+
+    // Lines of one SCAN_BATCH of the file
+    struct LineBatch {
+        size_t bytes;                 // Characters covered
+        size_t extra;                 // Characters up to and including the first '\n'
+        unique_ptr<LineIndex> rest;   // The lines after that '\n', or null if there is none
+    };
+
+    struct Scan {
+        thread worker;
+        mutex lock;
+        condition_variable ready;
+        deque<LineBatch> batches;
+        bool finished = false;
+        atomic<bool> stop{false};
+    };
+
+    mutable unique_ptr<Scan> scan;   // Set while the background scan is running
+    mutable size_t indexedUpTo = 0;  // While it runs, 'lines' covers only [0, indexedUpTo)
+
+    static void scanText(Scan* scan, const char* data, size_t len) {
+        for (size_t from = 0; from < len && !scan->stop; from += SCAN_BATCH) {
+            size_t to = min(len, from + SCAN_BATCH);
+            LineBatch batch;
+            batch.bytes = to - from;
+            const char* newline = (const char*)memchr(data + from, '\n', to - from);
+            if (!newline) {
+                batch.extra = to - from;
+            } else {
+                batch.extra = newline - (data + from) + 1;
+                LineScanner scanner;
+                scanner.feed(newline + 1, data + to - newline - 1);
+                batch.rest.reset(new LineIndex((unsigned)(from / SCAN_BATCH) + 1));
+                batch.rest->assign(scanner.finish());
+            }
+            lock_guard<mutex> guard(scan->lock);
+            scan->batches.push_back(move(batch));
+            scan->ready.notify_one();
+        }
+        lock_guard<mutex> guard(scan->lock);
+        scan->finished = true;
+        scan->ready.notify_one();
+    }
+
+protected:
+    mutable LineIndex lines;
+
+    // Merge in what the scan has found until 'lines' covers the first 'bytes'
+    // characters and knows where line 'line' starts (or the scan is done)
+    void waitForIndex(size_t bytes, size_t line) const {
+        if (!scan) return;
+        unique_lock<mutex> guard(scan->lock);
+        while (true) {
+            for (LineBatch& batch : scan->batches) {
+                lines.append(batch.extra, batch.rest.get());
+                indexedUpTo += batch.bytes;
+            }
+            scan->batches.clear();
+            if (scan->finished) {
+                guard.unlock();
+                scan->worker.join();
+                scan.reset();
+                return;
+            }
+            if (indexedUpTo >= bytes && lines.lineCount() > line) return;
+            scan->ready.wait(guard);
+        }
+    }
+
+    // Index [data, data + len), which must stay valid and unchanged until the
+    // scan finishes or is cancelled, as the whole text, on a background thread
+    void indexInBackground(const char* data, size_t len) {
+        cancelIndexing();
+        lines.assign(vector<size_t>(1, 0));
+        indexedUpTo = 0;
+        scan.reset(new Scan());
+        scan->worker = thread(scanText, scan.get(), data, len);
+    }
+
+    // Stop the scan (the index is incomplete afterwards). Engines must call
+    // this before the text it reads goes away.
+    void cancelIndexing() {
+        if (!scan) return;
+        scan->stop = true;
+        scan->worker.join();
+        scan.reset();
+    }
+
+    // Engines call these on every edit so the index follows the text
+    void indexInsert(size_t pos, const string& text) {
+        waitForIndex(pos, 0);
+        lines.insert(pos, text.data(), text.size());
+        if (scan) indexedUpTo += text.size();
+    }
+
+    void indexErase(size_t pos, size_t len) {
+        waitForIndex(pos + len, 0);
+        lines.erase(pos, len);
+        if (scan) indexedUpTo -= len;
+    }
+
+public:
+    ~IndexedBuffer() { cancelIndexing(); }
+
+    // Is the background scan still reading the text?
+    bool indexing() const {
+        waitForIndex(0, 0); // Picks up a finished scan
+        return scan != nullptr;
+    }
+
+    int countLines(size_t to) const override {
+        waitForIndex(to, 0);
+        return (int)lines.lineOf(to);
+    }
+
+    size_t lineStart(size_t pos) const override {
+        waitForIndex(pos, 0);
+        return lines.lineOffset(lines.lineOf(pos));
+    }
+
+    size_t lineEnd(size_t pos) const override {
+        waitForIndex(pos, 0);
+        size_t line = lines.lineOf(pos);
+        waitForIndex(pos, line + 1);
+        if (line + 1 >= lines.lineCount()) return size();
+        return lines.lineOffset(line + 1) - 1;
+    }
+
+    size_t lineOffset(size_t line) const override {
+        waitForIndex(0, line);
+        return line < lines.lineCount() ? lines.lineOffset(line) : size();
+    }
+};
+//Line index ends
+
+//Gap buffer text core starts
+// The whole document lives in one contiguous array with a "gap" at the cursor.
+// Typing fills the gap and deleting widens it, so both are O(1); moving the
+// cursor slides the gap and costs only the distance moved.
+class GapBuffer : public IndexedBuffer {
+private:
+    vector<char> buf;      // Text before the gap, the gap itself, then text after it
+    size_t gapStart = 0;   // First free slot (this is the cursor)
+    size_t gapEnd = 0;     // One past the last free slot
+    mutable shared_future<void> copying; // Snapshot copy that may still be reading buf
+
+    // The text copied out for a snapshot() by a helper thread
+    class Snapshot : public TextView {
+    private:
+        size_t length;
+        shared_ptr<string> copy;
+        shared_future<void> copied;
+
+    public:
+        Snapshot(size_t length, shared_ptr<string> copy, shared_future<void> copied)
+            : length(length), copy(copy), copied(copied) {}
+
+        size_t size() const override { return length; }
+        char at(size_t i) const override { copied.wait(); return (*copy)[i]; }
+        void forEachChunk(size_t from, size_t to, const function<void(const char*, size_t)>& fn) const override {
+            copied.wait();
+            if (from < to) fn(copy->data() + from, to - from);
+        }
+    };
+
+    // Called before buf changes: a snapshot still being copied must see the
+    // text as it was when it was taken
+    void waitForSnapshot() {
+        if (!copying.valid()) return;
+        copying.wait();
+        copying = shared_future<void>();
+    }
+
+    // Grow the gap so that at least 'needed' more characters fit
+    void growGap(size_t needed) {
+        size_t oldSize = buf.size();
+        size_t newSize = max(oldSize * 2, oldSize + needed + 64);
+        size_t tail = oldSize - gapEnd;
+        buf.resize(newSize);
+        // Slide the text after the gap to the end of the bigger array
+        copy_backward(buf.begin() + gapEnd, buf.begin() + oldSize, buf.end());
+        gapEnd = newSize - tail;
+    }
+
+    // Move the gap to logical position pos
+    void moveGap(size_t pos) {
+        pos = min(pos, size());
+        if (pos < gapStart) {
+            size_t n = gapStart - pos;
+            copy_backward(buf.begin() + pos, buf.begin() + gapStart, buf.begin() + gapEnd);
+            gapStart -= n;
+            gapEnd -= n;
+        } else if (pos > gapStart) {
+            size_t n = pos - gapStart;
+            copy(buf.begin() + gapEnd, buf.begin() + gapEnd + n, buf.begin() + gapStart);
+            gapStart += n;
+            gapEnd += n;
+        }
+    }
+
+public:
+    GapBuffer() { buf.resize(64); gapEnd = buf.size(); }
+    ~GapBuffer() { waitForSnapshot(); }
+
+    size_t size() const override { return buf.size() - (gapEnd - gapStart); }
+
+    // Character at logical position i (0 <= i < size())
+    char at(size_t i) const override { return i < gapStart ? buf[i] : buf[i + (gapEnd - gapStart)]; }
+
+    void replaceChar(size_t i, char ch) override {
+        waitForSnapshot();
+        char old = at(i);
+        editVersion++;
+        if (old == '\n' || ch == '\n') {
+            indexErase(i, 1);
+            indexInsert(i, string(1, ch));
+        }
+        if (i < gapStart) buf[i] = ch;
+        else buf[i + (gapEnd - gapStart)] = ch;
+    }
+
+    // Insert at pos; the gap follows, so typing at the cursor stays O(1)
+    void insert(size_t pos, const string& text) override {
+        waitForSnapshot();
+        indexInsert(pos, text);
+        editVersion++;
+        moveGap(pos);
+        if (gapEnd - gapStart < text.size()) growGap(text.size());
+        copy(text.begin(), text.end(), buf.begin() + gapStart);
+        gapStart += text.size();
+    }
+
+    // Delete [pos, pos + len) by widening the gap over it
+    void erase(size_t pos, size_t len) override {
+        waitForSnapshot();
+        moveGap(pos);
+        len = min(len, buf.size() - gapEnd);
+        indexErase(pos, len);
+        editVersion++;
+        gapEnd += len;
+    }
+
+    void forEachChunk(size_t from, size_t to, const function<void(const char*, size_t)>& fn) const override {
+        if (from < gapStart) fn(buf.data() + from, min(to, gapStart) - from);
+        if (to > gapStart) {
+            size_t start = max(from, gapStart);
+            fn(buf.data() + start + (gapEnd - gapStart), to - start);
+        }
+    }
+
+    // The array is edited in place, so the text has to be copied. That runs on
+    // a helper thread; the editor only waits for it if it edits again before
+    // the copy is done, and then only for the copy, never for the disk.
+    unique_ptr<TextView> snapshot() const override {
+        auto copy = make_shared<string>();
+        copying = async(launch::async, [this, copy] { *copy = text(); }).share();
+        return unique_ptr<TextView>(new Snapshot(size(), copy, copying));
+    }
+};
+//Gap buffer text core ends
+
+//Piece table document model starts
+// Read-only memory mapping of a whole file. Mapping is O(1) in the file size;
+// pages are only read from disk when they are first touched.
+class MappedFile {
+private:
+    const char* fileData = nullptr;
+    size_t fileSize = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = NULL;
+#endif
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        // Share delete access so a save can replace the file while it is mapped
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        GetFileSizeEx(fileHandle, &length);
+        fileSize = (size_t)length.QuadPart;
+        if (fileSize == 0) return true; // Empty files cannot be mapped, nothing to read anyway
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) { close(); return false; }
+        fileData = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (fileData == nullptr) { close(); return false; }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) { ::close(fd); return false; }
+        fileSize = (size_t)info.st_size;
+        if (fileSize > 0) {
+            void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) { ::close(fd); fileSize = 0; return false; }
+            fileData = (const char*)mapped;
+        }
+        ::close(fd); // The mapping keeps the file alive
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (fileData) UnmapViewOfFile(fileData);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (fileData) munmap((void*)fileData, fileSize);
+#endif
+        fileData = nullptr;
+        fileSize = 0;
+    }
+
+    const char* data() const { return fileData; }
+    size_t size() const { return fileSize; }
+};
+
+// Length of the document text in a file written by updateTextFile(), i.e.
+// without the blank lines and "Current Word Count" footer. Only looks at the tail.
+size_t documentLength(const char* data, size_t size) {
+    const string footer = "\n\n\n\n\nCurrent Word Count: ";
+    size_t end = size;
+    if (end > 0 && data[end - 1] == '\n') end--;
+    size_t digitsEnd = end;
+    while (end > 0 && isdigit((unsigned char)data[end - 1])) end--;
+    if (end == digitsEnd || end < footer.size()) return size;
+    if (footer.compare(0, footer.size(), data + end - footer.size(), footer.size()) != 0) return size;
+    return end - footer.size();
+}
+
+// Move 'from' over 'to', replacing it. Readers that still map the old file
+// (a piece table) keep seeing the old contents.
+bool replaceFile(const string& from, const string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// The document is a sequence of pieces, each pointing either into the mapped
+// original file or into append-only "add" blocks that receive every insert.
+// Pieces are kept in a treap ordered by document position, each node caching the
+// length of its subtree, so finding, splitting and joining pieces is O(log pieces).
+class PieceTable : public IndexedBuffer {
+private:
+    struct Piece {
+        const char* data;      // Text, inside the original file or an add block
+        size_t len;
+        size_t total;          // Length of the whole subtree rooted here
+        unsigned priority;     // Random heap priority that keeps the treap balanced
+        Piece* left = nullptr;
+        Piece* right = nullptr;
+    };
+
+    // Inserted text, in insertion order. A block is never moved or freed while
+    // a piece may point into it, and written bytes never change, so snapshots
+    // can keep reading them while typing appends more.
+    struct AddBlocks {
+        vector<unique_ptr<char[]>> blocks;
+    };
+    static constexpr size_t ADD_BLOCK = 1 << 16;
+
+    shared_ptr<MappedFile> original;  // The file as it was opened, never written to
+    size_t originalLength = 0;        // Bytes of the original that belong to the document
+    shared_ptr<AddBlocks> added = make_shared<AddBlocks>(); // Shared with snapshots still pointing into it
+    char* addEnd = nullptr;           // Next free byte of the last block
+    size_t addRoom = 0;               // Free bytes left in the last block
+    Piece* root = nullptr;
+    mt19937 rng{12345};
+
+    // Frozen piece list of a snapshot(); keeps the file and the add blocks alive
+    class Snapshot : public TextView {
+    private:
+        vector<const char*> data;
+        vector<size_t> starts;        // Document offset of each piece, plus the total at the end
+        shared_ptr<MappedFile> original;
+        shared_ptr<AddBlocks> added;
+
+    public:
+        Snapshot(const PieceTable& table) : original(table.original), added(table.added) {
+            starts.push_back(0);
+            table.forEachChunk(0, table.size(), [&](const char* text, size_t len) {
+                data.push_back(text);
+                starts.push_back(starts.back() + len);
+            });
+        }
+
+        size_t size() const override { return starts.back(); }
+
+        char at(size_t i) const override {
+            size_t k = upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+            return data[k][i - starts[k]];
+        }
+
+        void forEachChunk(size_t from, size_t to, const function<void(const char*, size_t)>& fn) const override {
+            size_t k = upper_bound(starts.begin(), starts.end(), from) - starts.begin() - 1;
+            for (; k < data.size() && starts[k] < to; k++) {
+                size_t s = max(from, starts[k]), e = min(to, starts[k + 1]);
+                fn(data[k] + (s - starts[k]), e - s);
+            }
+        }
+    };
+
+    static size_t total(const Piece* p) { return p ? p->total : 0; }
+    static void update(Piece* p) { p->total = total(p->left) + p->len + total(p->right); }
+
+    // Copy text into the add blocks, starting a new block if it does not fit
+    // in the last one. Returns where it was stored.
+    const char* appendAdded(const string& text) {
+        if (text.size() > addRoom) {
+            size_t blockSize = max(ADD_BLOCK, text.size());
+            added->blocks.emplace_back(new char[blockSize]);
+            addEnd = added->blocks.back().get();
+            addRoom = blockSize;
+        }
+        char* stored = addEnd;
+        memcpy(stored, text.data(), text.size());
+        addEnd += text.size();
+        addRoom -= text.size();
+        return stored;
+    }
+
+    Piece* makePiece(const char* data, size_t len) {
+        Piece* p = new Piece();
+        p->data = data;
+        p->len = len;
+        p->total = len;
+        p->priority = rng();
+        return p;
+    }
+
+    Piece* merge(Piece* a, Piece* b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (a->priority > b->priority) {
+            a->right = merge(a->right, b);
+            update(a);
+            return a;
+        }
+        b->left = merge(a, b->left);
+        update(b);
+        return b;
+    }
+
+    // Split t so that 'a' holds the first pos characters and 'b' the rest,
+    // cutting a piece in two if pos falls inside it
+    void split(Piece* t, size_t pos, Piece*& a, Piece*& b) {
+        if (!t) { a = b = nullptr; return; }
+        size_t leftTotal = total(t->left);
+        if (pos <= leftTotal) {
+            split(t->left, pos, a, t->left);
+            update(t);
+            b = t;
+        } else if (pos >= leftTotal + t->len) {
+            split(t->right, pos - leftTotal - t->len, t->right, b);
+            update(t);
+            a = t;
+        } else {
+            size_t cut = pos - leftTotal;
+            Piece* rest = makePiece(t->data + cut, t->len - cut);
+            Piece* right = t->right;
+            t->len = cut;
+            t->right = nullptr;
+            update(t);
+            a = t;
+            b = merge(rest, right);
+        }
+    }
+
+    // If the last piece of t ends exactly where this insert was stored (the
+    // user kept typing), grow it instead of adding a new piece
+    bool extendLast(Piece* t, const char* stored, size_t n) {
+        if (!t) return false;
+        bool extended = t->right ? extendLast(t->right, stored, n)
+                                 : (t->data + t->len == stored);
+        if (extended) {
+            if (!t->right) t->len += n;
+            t->total += n;
+        }
+        return extended;
+    }
+
+    void destroy(Piece* p) {
+        if (!p) return;
+        destroy(p->left);
+        destroy(p->right);
+        delete p;
+    }
+
+    void visit(const Piece* t, size_t base, size_t from, size_t to, const function<void(const char*, size_t)>& fn) const {
+        if (!t) return;
+        size_t pieceStart = base + total(t->left);
+        size_t pieceEnd = pieceStart + t->len;
+        if (from < pieceStart) visit(t->left, base, from, to, fn);
+        size_t s = max(from, pieceStart), e = min(to, pieceEnd);
+        if (s < e) fn(t->data + (s - pieceStart), e - s);
+        if (to > pieceEnd) visit(t->right, pieceEnd, from, to, fn);
+    }
+
+public:
+    PieceTable() {}
+    PieceTable(const PieceTable&) = delete;
+    PieceTable& operator=(const PieceTable&) = delete;
+    ~PieceTable() {
+        cancelIndexing(); // The scan reads 'original', which is unmapped before ~IndexedBuffer runs
+        destroy(root);
+    }
+
+    // Map 'path' as the original text. O(1) in the file size: nothing is read yet.
+    bool open(const string& path) {
+        cancelIndexing();
+        shared_ptr<MappedFile> file = make_shared<MappedFile>();
+        if (!file->open(path)) return false;
+        destroy(root);
+        root = nullptr;
+        original = file;
+        added = make_shared<AddBlocks>();
+        addEnd = nullptr;
+        addRoom = 0;
+        originalLength = documentLength(original->data(), original->size());
+        if (originalLength > 0) root = makePiece(original->data(), originalLength);
+        // Lines are counted in the background, so the first screen can be
+        // shown before the rest of the file has even been read
+        indexInBackground(original->data(), originalLength);
+        return true;
+    }
+
+    size_t size() const override { return total(root); }
+
+    // Are the bytes of the original file from 'from' on unused, so the file
+    // may be rewritten in place from there? Pieces only ever lose original
+    // text, so once true this stays true. O(pieces).
+    bool originalUnusedFrom(size_t from) const {
+        if (indexing()) return false; // The line scan still reads all of it
+        if (!original || !original->data()) return true;
+        uintptr_t base = (uintptr_t)original->data();
+        bool unused = true;
+        forEachChunk(0, size(), [&](const char* data, size_t len) {
+            uintptr_t at = (uintptr_t)data;
+            if (at >= base && at < base + originalLength && at - base + len > from) unused = false;
+        });
+        return unused;
+    }
+
+    // The text as it was opened. It never changes, so other threads may read
+    // it while the document is edited.
+    const char* originalText() const { return original ? original->data() : nullptr; }
+    size_t originalSize() const { return originalLength; }
+
+    char at(size_t i) const override {
+        const Piece* t = root;
+        while (t) {
+            size_t leftTotal = total(t->left);
+            if (i < leftTotal) {
+                t = t->left;
+            } else if (i < leftTotal + t->len) {
+                return t->data[i - leftTotal];
+            } else {
+                i -= leftTotal + t->len;
+                t = t->right;
+            }
+        }
+        return '\0';
+    }
+
+    void insert(size_t pos, const string& text) override {
+        if (text.empty()) return;
+        indexInsert(pos, text);
+        editVersion++;
+        // Only text added to the same block right after the last insert can
+        // continue a piece
+        bool sameBlock = text.size() <= addRoom && addEnd != added->blocks.back().get();
+        const char* stored = appendAdded(text);
+        Piece *a, *b;
+        split(root, pos, a, b);
+        if (!sameBlock || !extendLast(a, stored, text.size())) {
+            a = merge(a, makePiece(stored, text.size()));
+        }
+        root = merge(a, b);
+    }
+
+    void erase(size_t pos, size_t len) override {
+        len = min(len, size() - min(pos, size()));
+        indexErase(pos, len);
+        editVersion++;
+        Piece *a, *b, *middle, *c;
+        split(root, pos, a, b);
+        split(b, len, middle, c);
+        destroy(middle);
+        root = merge(a, c);
+    }
+
+    void forEachChunk(size_t from, size_t to, const function<void(const char*, size_t)>& fn) const override {
+        if (from < to) visit(root, 0, from, to, fn);
+    }
+
+    // Copies only the piece list (O(pieces)); no text is read here
+    unique_ptr<TextView> snapshot() const override { return unique_ptr<TextView>(new Snapshot(*this)); }
+};
+//Piece table document model ends
+
+//Rope buffer starts
+// A balanced (AVL) binary tree whose leaves hold chunks of up to MAX_LEAF
+// characters. Every node caches the length and the number of '\n' in its
+// subtree, so positions and line numbers are found in O(log n). Nodes are
+// never modified after creation: an edit copies only the path it touches
+// and shares everything else, which makes split, concat and slicing of
+// arbitrary ranges O(log n) and copying a whole Rope O(1).
+struct RopeNode;
+typedef shared_ptr<const RopeNode> RopePtr;
+
+struct RopeNode {
+    RopePtr left, right;  // Both null for a leaf
+    string chunk;         // Text of a leaf
+    size_t length = 0;    // Characters in this subtree
+    size_t newlines = 0;  // '\n' characters in this subtree
+    int height = 1;       // Leaves have height 1
+    uint64_t hash = 0;    // hashAppend() of the subtree's text
+    uint64_t power = 1;   // HASH_BASE^length, to combine hashes in O(1)
+};
+
+class Rope : public TextBuffer {
+private:
+    static const size_t MAX_LEAF = 512;
+    RopePtr root;
+
+    static int height(const RopePtr& p) { return p ? p->height : 0; }
+    static size_t length(const RopePtr& p) { return p ? p->length : 0; }
+    static bool isLeaf(const RopePtr& p) { return !p->left; }
+
+    static RopePtr makeLeaf(const string& text) {
+        if (text.empty()) return nullptr;
+        auto leaf = make_shared<RopeNode>();
+        leaf->chunk = text;
+        leaf->length = text.size();
+        leaf->newlines = std::count(text.begin(), text.end(), '\n');
+        leaf->hash = hashAppend(0, text.data(), text.size());
+        for (size_t i = 0; i < text.size(); i++) leaf->power *= HASH_BASE;
+        return leaf;
+    }
+
+    // Internal node over two non-empty subtrees
+    static RopePtr makeNode(const RopePtr& l, const RopePtr& r) {
+        auto node = make_shared<RopeNode>();
+        node->left = l;
+        node->right = r;
+        node->length = l->length + r->length;
+        node->newlines = l->newlines + r->newlines;
+        node->height = max(l->height, r->height) + 1;
+        node->hash = l->hash * r->power + r->hash;
+        node->power = l->power * r->power;
+        return node;
+    }
+
+    // Node over l and r whose heights differ by at most 2, rotating if needed
+    static RopePtr balance(const RopePtr& l, const RopePtr& r) {
+        if (!l) return r;
+        if (!r) return l;
+        if (height(l) > height(r) + 1) {
+            if (height(l->left) >= height(l->right)) return makeNode(l->left, makeNode(l->right, r));
+            return makeNode(makeNode(l->left, l->right->left), makeNode(l->right->right, r));
+        }
+        if (height(r) > height(l) + 1) {
+            if (height(r->right) >= height(r->left)) return makeNode(makeNode(l, r->left), r->right);
+            return makeNode(makeNode(l, r->left->left), makeNode(r->left->right, r->right));
+        }
+        return makeNode(l, r);
+    }
+
+    // Concatenate two trees of any heights in O(|height difference|)
+    static RopePtr join(const RopePtr& a, const RopePtr& b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (height(a) > height(b) + 1) return balance(a->left, join(a->right, b));
+        if (height(b) > height(a) + 1) return balance(join(a, b->left), b->right);
+        if (isLeaf(a) && isLeaf(b) && a->length + b->length <= MAX_LEAF) return makeLeaf(a->chunk + b->chunk);
+        return makeNode(a, b);
+    }
+
+    // 'a' gets the first pos characters of t and 'b' the rest
+    static void split(const RopePtr& t, size_t pos, RopePtr& a, RopePtr& b) {
+        if (!t) { a = b = nullptr; return; }
+        if (pos == 0) { a = nullptr; b = t; return; }
+        if (pos >= t->length) { a = t; b = nullptr; return; }
+        if (isLeaf(t)) {
+            a = makeLeaf(t->chunk.substr(0, pos));
+            b = makeLeaf(t->chunk.substr(pos));
+            return;
+        }
+        RopePtr middle;
+        if (pos <= t->left->length) {
+            split(t->left, pos, a, middle);
+            b = join(middle, t->right);
+        } else {
+            split(t->right, pos - t->left->length, middle, b);
+            a = join(t->left, middle);
+        }
+    }
+
+    // Balanced tree over the chunks of text
+    static RopePtr build(const string& text, size_t from, size_t to) {
+        if (to - from <= MAX_LEAF) return makeLeaf(text.substr(from, to - from));
+        size_t chunks = (to - from + MAX_LEAF - 1) / MAX_LEAF;
+        size_t mid = from + (chunks / 2) * MAX_LEAF;
+        return makeNode(build(text, from, mid), build(text, mid, to));
+    }
+
+    // Small insert: copy the path down to one leaf and edit it in place,
+    // so typing does not fragment the tree into one-character leaves
+    static RopePtr insertSmall(const RopePtr& t, size_t pos, const string& text) {
+        if (!t) return makeLeaf(text);
+        if (isLeaf(t)) {
+            string chunk = t->chunk;
+            chunk.insert(pos, text);
+            if (chunk.size() <= MAX_LEAF) return makeLeaf(chunk);
+            size_t half = chunk.size() / 2;
+            return makeNode(makeLeaf(chunk.substr(0, half)), makeLeaf(chunk.substr(half)));
+        }
+        if (pos <= t->left->length) return balance(insertSmall(t->left, pos, text), t->right);
+        return balance(t->left, insertSmall(t->right, pos - t->left->length, text));
+    }
+
+    // Small erase that stays inside one leaf, same idea as insertSmall
+    static RopePtr eraseSmall(const RopePtr& t, size_t pos, size_t len) {
+        if (isLeaf(t)) {
+            string chunk = t->chunk;
+            chunk.erase(pos, len);
+            return makeLeaf(chunk);
+        }
+        if (pos + len <= t->left->length) return balance(eraseSmall(t->left, pos, len), t->right);
+        return balance(t->left, eraseSmall(t->right, pos - t->left->length, len));
+    }
+
+    // True if [pos, pos + len) lies inside a single leaf
+    bool inOneLeaf(size_t pos, size_t len) const {
+        RopePtr t = root;
+        while (t && !isLeaf(t)) {
+            if (pos + len <= t->left->length) {
+                t = t->left;
+            } else if (pos >= t->left->length) {
+                pos -= t->left->length;
+                t = t->right;
+            } else {
+                return false;
+            }
+        }
+        return t != nullptr;
+    }
+
+    static void visit(const RopePtr& t, size_t base, size_t from, size_t to, const function<void(const char*, size_t)>& fn) {
+        if (!t || from >= base + t->length || to <= base) return;
+        if (isLeaf(t)) {
+            size_t s = max(from, base), e = min(to, base + t->length);
+            fn(t->chunk.data() + (s - base), e - s);
+            return;
+        }
+        visit(t->left, base, from, to, fn);
+        visit(t->right, base + t->left->length, from, to, fn);
+    }
+
+    explicit Rope(const RopePtr& node) : root(node) {}
+
+    // Fold the hash of [from, to) of t (t starts at 'base') into h, left to right
+    static void hashInto(const RopePtr& t, size_t base, size_t from, size_t to, uint64_t& h) {
+        if (!t || from >= base + t->length || to <= base) return;
+        if (from <= base && to >= base + t->length) {
+            h = h * t->power + t->hash; // Whole subtree: use the cached hash
+        } else if (isLeaf(t)) {
+            size_t s = max(from, base), e = min(to, base + t->length);
+            h = hashAppend(h, t->chunk.data() + (s - base), e - s);
+        } else {
+            hashInto(t->left, base, from, to, h);
+            hashInto(t->right, base + t->left->length, from, to, h);
+        }
+    }
+
+public:
+    Rope() {}
+    explicit Rope(const string& text) : root(text.empty() ? nullptr : build(text, 0, text.size())) {}
+
+    size_t size() const override { return length(root); }
+
+    char at(size_t i) const override {
+        RopePtr t = root;
+        while (t && !isLeaf(t)) {
+            if (i < t->left->length) {
+                t = t->left;
+            } else {
+                i -= t->left->length;
+                t = t->right;
+            }
+        }
+        return t ? t->chunk[i] : '\0';
+    }
+
+    // Take another rope's text (e.g. an undo snapshot) in O(1)
+    void assign(const Rope& other) {
+        root = other.root;
+        editVersion++;
+    }
+
+    uint64_t hashRange(size_t from, size_t to) const override {
+        uint64_t h = 0;
+        hashInto(root, 0, from, to, h);
+        return h;
+    }
+
+    uint64_t contentHash() const override { return root ? root->hash : 0; }
+
+    // Rough memory an edit adds to a snapshot: the copied path plus one leaf
+    size_t editBytes() const { return height(root) * sizeof(RopeNode) + MAX_LEAF; }
+
+    void insert(size_t pos, const string& text) override {
+        if (text.empty()) return;
+        editVersion++;
+        if (text.size() <= MAX_LEAF) {
+            root = insertSmall(root, pos, text);
+            return;
+        }
+        RopePtr a, b;
+        split(root, pos, a, b);
+        root = join(join(a, build(text, 0, text.size())), b);
+    }
+
+    void erase(size_t pos, size_t len) override {
+        len = min(len, size() - min(pos, size()));
+        if (len == 0) return;
+        editVersion++;
+        if (inOneLeaf(pos, len)) {
+            root = eraseSmall(root, pos, len);
+            return;
+        }
+        RopePtr a, b, middle, c;
+        split(root, pos, a, b);
+        split(b, len, middle, c);
+        root = join(a, c);
+    }
+
+    void forEachChunk(size_t from, size_t to, const function<void(const char*, size_t)>& fn) const override {
+        if (from < to) visit(root, 0, from, to, fn);
+    }
+
+    // Characters [from, to) as a new Rope sharing this one's nodes
+    Rope slice(size_t from, size_t to) const {
+        RopePtr a, b, middle, c;
+        split(root, from, a, b);
+        split(b, to - from, middle, c);
+        return Rope(middle);
+    }
+
+    // Insert a whole Rope at pos with one split and two joins
+    void insertRope(size_t pos, const Rope& other) {
+        RopePtr a, b;
+        split(root, pos, a, b);
+        root = join(join(a, other.root), b);
+        editVersion++;
+    }
+
+    // Replace [pos, pos + len) with text as one tree operation
+    void replace(size_t pos, size_t len, const string& text) override {
+        RopePtr a, b, middle, c;
+        split(root, pos, a, b);
+        split(b, len, middle, c);
+        root = join(join(a, text.empty() ? nullptr : build(text, 0, text.size())), c);
+        editVersion++;
+    }
+
+    static Rope concat(const Rope& a, const Rope& b) { return Rope(join(a.root, b.root)); }
+
+    // Number of '\n' in [0, to), O(log n) from the cached counts
+    int countLines(size_t to) const override {
+        size_t count = 0;
+        RopePtr t = root;
+        while (t && !isLeaf(t)) {
+            if (to <= t->left->length) {
+                t = t->left;
+            } else {
+                count += t->left->newlines;
+                to -= t->left->length;
+                t = t->right;
+            }
+        }
+        if (t) count += std::count(t->chunk.begin(), t->chunk.begin() + min(to, t->length), '\n');
+        return (int)count;
+    }
+
+    // Offset of the first character of line 'line' (0-based), O(log n)
+    size_t lineOffset(size_t line) const override {
+        if (line == 0) return 0;
+        size_t offset = 0;
+        RopePtr t = root;
+        while (t && !isLeaf(t)) {
+            if (line <= t->left->newlines) {
+                t = t->left;
+            } else {
+                line -= t->left->newlines;
+                offset += t->left->length;
+                t = t->right;
+            }
+        }
+        if (!t) return size();
+        for (size_t i = 0; i < t->length; i++) {
+            if (t->chunk[i] == '\n' && --line == 0) return offset + i + 1;
+        }
+        return size();
+    }
+
+    size_t lineStart(size_t pos) const override { return lineOffset(countLines(pos)); }
+
+    size_t lineEnd(size_t pos) const override {
+        size_t line = countLines(pos);
+        if (line >= (root ? root->newlines : 0)) return size();
+        return lineOffset(line + 1) - 1;
+    }
+
+    // O(1): nodes are never changed, so the copy shares all of them
+    unique_ptr<TextView> snapshot() const override { return unique_ptr<TextView>(new Rope(*this)); }
+};
+//Rope buffer ends
+
+// Text engine by name: "gap", "piece" or "rope" (the default)
+TextBuffer* makeBuffer(const string& engine) {
+    if (engine == "gap") return new GapBuffer();
+    if (engine == "piece") return new PieceTable();
+    return new Rope();
+}
+
+//Document statistics starts
+// Counts shown in the status line. Every count is decided at single
+// characters, from the character itself, the two before it and the one after
+// it, so counts of consecutive pieces of text add up and an edit only changes
+// the counts at the few characters around it.
+struct TextStats {
+    long long chars = 0;
+    long long nonSpace = 0;
+    long long newlines = 0;
+    long long words = 0;       // Non-space characters after a space (same rule as istringstream >> word)
+    long long letters = 0;     // Letters and digits, for the average word length
+    long long syllables = 0;   // Groups of vowels, a common estimate
+    long long sentences = 0;   // Runs of '.', '!' and '?'
+    long long paragraphs = 0;  // Lines with text after an empty line (or at the start)
+
+    TextStats& operator+=(const TextStats& o) {
+        chars += o.chars;
+        nonSpace += o.nonSpace;
+        newlines += o.newlines;
+        words += o.words;
+        letters += o.letters;
+        syllables += o.syllables;
+        sentences += o.sentences;
+        paragraphs += o.paragraphs;
+        return *this;
+    }
+
+    TextStats operator-(const TextStats& o) const {
+        TextStats d = *this;
+        d.chars -= o.chars;
+        d.nonSpace -= o.nonSpace;
+        d.newlines -= o.newlines;
+        d.words -= o.words;
+        d.letters -= o.letters;
+        d.syllables -= o.syllables;
+        d.sentences -= o.sentences;
+        d.paragraphs -= o.paragraphs;
+        return d;
+    }
+
+    long long lines() const { return newlines + 1; }
+    double averageWordLength() const { return words ? (double)letters / words : 0; }
+
+    // Flesch reading ease: higher is easier, 60-70 is plain English. Text
+    // without a full stop is taken as one sentence, and every word has at
+    // least one syllable.
+    double readability() const {
+        if (words == 0) return 0;
+        double perSentence = (double)words / max(sentences, 1LL);
+        double perWord = (double)max(syllables, words) / words;
+        return 206.835 - 1.015 * perSentence - 84.6 * perWord;
+    }
+};
+
+// Computes TextStats over text fed to it in order, in any number of chunks.
+// It can start and stop in the middle of a document: pass the two
+// characters before the first one counted, and the one after the last.
+class StatsScanner {
+public:
+    static const int NONE = -1; // Start or end of the document
+
+private:
+    // Character classes, looked up in one table so the loop has no branches
+    enum { SPACE = 1, NEWLINE = 2, ALNUM = 4, VOWEL = 8, TERMINATOR = 16 };
+    static const unsigned char EDGE = SPACE | NEWLINE; // Class of NONE: words and paragraphs start after it
+
+    unsigned char before2, before1; // Classes of the two characters before 'current'
+    unsigned char current = 0;      // Counted once the character after it is known
+    bool hasCurrent = false;
+    TextStats stats;
+
+    static const unsigned char* classes() {
+        static unsigned char table[256];
+        static bool built = false;
+        if (!built) {
+            for (int ch = 0; ch < 256; ch++) {
+                unsigned char c = 0;
+                if (isspace(ch)) c |= SPACE;
+                if (ch == '\n') c |= NEWLINE;
+                if (isalnum(ch)) c |= ALNUM;
+                if (ch != 0 && strchr("aeiouyAEIOUY", ch)) c |= VOWEL;
+                if (ch == '.' || ch == '!' || ch == '?') c |= TERMINATOR;
+                table[ch] = c;
+            }
+            built = true;
+        }
+        return table;
+    }
+
+    static unsigned char classOf(int ch) { return ch == NONE ? EDGE : classes()[(unsigned char)ch]; }
+
+    // Count a character of class 'cur' after c2, c1 and before 'next'
+    static void settle(TextStats& s, unsigned char c2, unsigned char c1, unsigned char cur, unsigned char next) {
+        s.chars++;
+        s.nonSpace += !(cur & SPACE);
+        s.newlines += (cur & NEWLINE) != 0;
+        s.words += !(cur & SPACE) & ((c1 & SPACE) != 0);
+        s.letters += (cur & ALNUM) != 0;
+        s.syllables += ((cur & VOWEL) != 0) & !(c1 & VOWEL);
+        s.sentences += ((cur & TERMINATOR) != 0) & !(next & TERMINATOR);
+        s.paragraphs += !(cur & NEWLINE) & ((c1 & NEWLINE) != 0) & ((c2 & NEWLINE) != 0);
+    }
+
+public:
+    explicit StatsScanner(int before2 = NONE, int before1 = NONE)
+        : before2(classOf(before2)), before1(classOf(before1)) {}
+
+    void feed(const char* data, size_t len) {
+        const unsigned char* table = classes();
+        size_t i = 0;
+        if (len > 0 && !hasCurrent) {
+            current = table[(unsigned char)data[i++]];
+            hasCurrent = true;
+        }
+        unsigned char c2 = before2, c1 = before1, cur = current;
+        TextStats local; // Kept in registers by the loop
+        for (; i < len; i++) {
+            unsigned char next = table[(unsigned char)data[i]];
+            settle(local, c2, c1, cur, next);
+            c2 = c1;
+            c1 = cur;
+            cur = next;
+        }
+        before2 = c2;
+        before1 = c1;
+        current = cur;
+        stats += local;
+    }
+
+    // The counts, given the character after the text fed in
+    TextStats finish(int next = NONE) {
+        if (hasCurrent) settle(stats, before2, before1, current, classOf(next));
+        hasCurrent = false;
+        return stats;
+    }
+};
+
+TextStats statsOf(const char* data, size_t len) {
+    StatsScanner scanner;
+    scanner.feed(data, len);
+    return scanner.finish();
+}
+
+// Change in the statistics when 'removed' at pos is replaced by 'inserted'.
+// 'text' may hold the document before or after the edit, with lenNow the
+// length of the edited range in it: only the characters around it are read.
+// The counts of the characters from one before the edit to two after it are
+// taken again, which costs O(edit) whatever the document's size.
+TextStats statsChange(const TextBuffer& text, size_t pos, size_t lenNow, const string& removed, const string& inserted) {
+    size_t from = pos >= 3 ? pos - 3 : 0;
+    size_t end = pos + lenNow;
+    size_t to = min(text.size(), end + 3);
+    string left = text.substr(from, pos), right = text.substr(end, to);
+    auto local = [&](const string& middle) {
+        string window = left + middle + right;
+        size_t first = left.empty() ? 0 : left.size() - 1;
+        size_t last = min(window.size(), left.size() + middle.size() + 2);
+        StatsScanner scanner(first >= 2 ? (unsigned char)window[first - 2] : StatsScanner::NONE,
+                             first >= 1 ? (unsigned char)window[first - 1] : StatsScanner::NONE);
+        scanner.feed(window.data() + first, last - first);
+        return scanner.finish(last < window.size() ? (unsigned char)window[last] : StatsScanner::NONE);
+    };
+    return local(inserted) - local(removed);
+}
+//Document statistics ends
+
+//Vectorized counting starts
+// Lines, words and bytes of raw text, as wc prints them, at memory speed.
+// Bytes are classified 64 at a time: one compare per whitespace class gives
+// a 64-bit mask of spaces, a word starts wherever a non-space follows a
+// space ((spaces << 1) & ~spaces, with the bit carried over from the
+// previous block), and popcount adds them up. AVX2 is used when the CPU has
+// it, SSE2 otherwise on x86-64, and a scalar loop elsewhere.
+struct TextCounts {
+    uint64_t lines = 0;   // '\n' characters, like wc -l
+    uint64_t words = 0;   // Whitespace separated words (same rule as istringstream >> word)
+    uint64_t bytes = 0;
+
+    TextCounts& operator+=(const TextCounts& o) {
+        lines += o.lines;
+        words += o.words;
+        bytes += o.bytes;
+        return *this;
+    }
+};
+
+enum CountMethod { COUNT_SCALAR, COUNT_SSE2, COUNT_AVX2 };
+
+// isspace() in the "C" locale: ' ', '\t', '\n', '\v', '\f' and '\r'
+inline bool isWordSpace(unsigned char ch) { return ch == ' ' || (unsigned char)(ch - '\t') <= '\r' - '\t'; }
+
+inline int popcount64(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Count data[i, len) one byte at a time. 'spaceBefore' is 1 if the byte
+// before data[i] is a space or the start of the text.
+void countScalar(const char* data, size_t len, size_t i, TextCounts& counts, uint64_t& spaceBefore) {
+    for (; i < len; i++) {
+        unsigned char ch = data[i];
+        uint64_t space = isWordSpace(ch);
+        counts.words += spaceBefore & !space;
+        counts.lines += ch == '\n';
+        spaceBefore = space;
+    }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// Whole 64-byte blocks from data[i] on; i is left at the first byte not counted
+void countSSE2(const char* data, size_t len, size_t& i, TextCounts& counts, uint64_t& spaceBefore) {
+    const __m128i blank = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i controlRange = _mm_set1_epi8('\r' - '\t'), newline = _mm_set1_epi8('\n');
+    for (; i + 64 <= len; i += 64) {
+        uint64_t spaces = 0, newlines = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i + 16 * part));
+            __m128i offset = _mm_sub_epi8(v, tab); // '\t'..'\r' become 0..4, unsigned
+            __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, controlRange), offset);
+            __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, blank), control);
+            spaces |= (uint64_t)(uint32_t)_mm_movemask_epi8(space) << (16 * part);
+            newlines |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << (16 * part);
+        }
+        counts.words += popcount64(~spaces & ((spaces << 1) | spaceBefore));
+        counts.lines += popcount64(newlines);
+        spaceBefore = spaces >> 63;
+    }
+}
+
+#ifdef __GNUC__
+__attribute__((target("avx2,popcnt")))
+void countAVX2(const char* data, size_t len, size_t& i, TextCounts& counts, uint64_t& spaceBefore) {
+    const __m256i blank = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i controlRange = _mm256_set1_epi8('\r' - '\t'), newline = _mm256_set1_epi8('\n');
+    for (; i + 64 <= len; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+        __m256i loOffset = _mm256_sub_epi8(lo, tab), hiOffset = _mm256_sub_epi8(hi, tab);
+        __m256i loSpace = _mm256_or_si256(_mm256_cmpeq_epi8(lo, blank),
+                                          _mm256_cmpeq_epi8(_mm256_min_epu8(loOffset, controlRange), loOffset));
+        __m256i hiSpace = _mm256_or_si256(_mm256_cmpeq_epi8(hi, blank),
+                                          _mm256_cmpeq_epi8(_mm256_min_epu8(hiOffset, controlRange), hiOffset));
+        uint64_t spaces = (uint32_t)_mm256_movemask_epi8(loSpace) | (uint64_t)(uint32_t)_mm256_movemask_epi8(hiSpace) << 32;
+        uint64_t newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline)) |
+                            (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)) << 32;
+        counts.words += __builtin_popcountll(~spaces & ((spaces << 1) | spaceBefore));
+        counts.lines += __builtin_popcountll(newlines);
+        spaceBefore = spaces >> 63;
+    }
+}
+#endif
+#endif
+
+// Fastest method this CPU supports
+CountMethod bestCountMethod() {
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef __GNUC__
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return COUNT_AVX2;
+#endif
+    return COUNT_SSE2;
+#else
+    return COUNT_SCALAR;
+#endif
+}
+
+// Count [data, data + len). 'inWord' says whether the byte before data was
+// part of a word (false at the start of a text) and is updated, so a text can
+// be counted in consecutive pieces with the same result.
+TextCounts countText(const char* data, size_t len, bool& inWord, CountMethod method = bestCountMethod()) {
+    TextCounts counts;
+    counts.bytes = len;
+    uint64_t spaceBefore = !inWord;
+    size_t i = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef __GNUC__
+    if (method == COUNT_AVX2) countAVX2(data, len, i, counts, spaceBefore);
+#endif
+    if (method != COUNT_SCALAR) countSSE2(data, len, i, counts, spaceBefore);
+#endif
+    countScalar(data, len, i, counts, spaceBefore);
+    inWord = !spaceBefore;
+    return counts;
+}
+
+// Counting on several threads. Each thread takes one slice of the text and
+// learns what it needs about the text before the slice from the bytes just
+// before it (whether it starts inside a word; for statistics the two
+// previous characters and the one after the slice), so the slices are
+// counted independently and their counts simply add up to the serial result.
+// Run count(from, to) on 'threads' slices of [0, len), the last on this
+// thread. threads == 0 picks one per core, fewer for small texts.
+template <class Count>
+void forEachSlice(size_t len, unsigned threads, const Count& count) {
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+        threads = (unsigned)min<size_t>(threads, max<size_t>(1, len / MIN_COUNT_SLICE));
+    }
+    threads = (unsigned)max<size_t>(1, min<size_t>(threads, len));
+    vector<thread> workers;
+    for (unsigned t = 0; t + 1 < threads; t++) {
+        workers.emplace_back(count, t, len / threads * t, len / threads * (t + 1));
+    }
+    count(threads - 1, len / threads * (threads - 1), len);
+    for (thread& worker : workers) worker.join();
+}
+
+TextCounts countTextParallel(const char* data, size_t len, unsigned threads = 0) {
+    vector<TextCounts> parts(max(1u, threads ? threads : thread::hardware_concurrency()));
+    forEachSlice(len, threads, [&](unsigned t, size_t from, size_t to) {
+        bool inWord = from > 0 && !isWordSpace(data[from - 1]);
+        parts[t] = countText(data + from, to - from, inWord);
+    });
+    TextCounts total;
+    for (const TextCounts& part : parts) total += part;
+    return total;
+}
+
+TextStats statsOfParallel(const char* data, size_t len, unsigned threads = 0) {
+    vector<TextStats> parts(max(1u, threads ? threads : thread::hardware_concurrency()));
+    forEachSlice(len, threads, [&](unsigned t, size_t from, size_t to) {
+        StatsScanner scanner(from >= 2 ? (unsigned char)data[from - 2] : StatsScanner::NONE,
+                             from >= 1 ? (unsigned char)data[from - 1] : StatsScanner::NONE);
+        scanner.feed(data + from, to - from);
+        parts[t] = scanner.finish(to < len ? (unsigned char)data[to] : StatsScanner::NONE);
+    });
+    TextStats total;
+    for (const TextStats& part : parts) total += part;
+    return total;
+}
+
+// --wc: print the lines, words and bytes of each file like wc, and a total
+// line for several files. Files are memory-mapped, not read.
+int runWordCount(const vector<string>& files) {
+    TextCounts total;
+    int status = 0;
+    for (const string& file : files) {
+        MappedFile mapped;
+        if (!mapped.open(file)) {
+            cerr << "wc: cannot open " << file << endl;
+            status = 1;
+            continue;
+        }
+        TextCounts counts = countTextParallel(mapped.data(), mapped.size());
+        printf("%8llu %8llu %8llu %s\n", (unsigned long long)counts.lines, (unsigned long long)counts.words,
+               (unsigned long long)counts.bytes, file.c_str());
+        total += counts;
+    }
+    if (files.size() > 1) {
+        printf("%8llu %8llu %8llu total\n", (unsigned long long)total.lines, (unsigned long long)total.words,
+               (unsigned long long)total.bytes);
+    }
+    return status;
+}
+//Vectorized counting ends
+
+//Auto-capitalization starts
+// The capitalization rules as a state machine over the typed characters:
+// the first letter of the document, of a line and of a sentence (after .?!
+// and any spaces) is made upper case, and a lone "i" becomes "I" once the
+// space, newline or punctuation after it is typed. One table lookup per
+// character, no allocation, and the state carries across lines. Typing and
+// the batch pass over whole files (capitalize()) share the same table.
+class Capitalizer {
+public:
+    enum State : unsigned char {
+        SENTENCE_START, // The next letter starts a sentence
+        WORD_GAP,       // Between words inside a sentence
+        IN_WORD,
+        LONE_I          // Just after an "i" that started a word
+    };
+
+    static const int NONE = -1; // End of the text
+
+private:
+    enum Class : unsigned char { OTHER, LETTER_I, SPACE, NEWLINE, TERMINATOR, CLASSES };
+    // Bits of a step: the next state in the low two, and what to do
+    enum { STATE_BITS = 3, UPPER = 4, FIX_I = 8 };
+
+    struct Tables {
+        unsigned char classes[256];
+        unsigned char next[4][CLASSES];
+        unsigned char step[4][256]; // State and character to next state plus UPPER / FIX_I
+        uint16_t steps[256];        // A character's steps from all four states, four bits each
+        Tables() {
+            for (int ch = 0; ch < 256; ch++) {
+                unsigned char c = OTHER;
+                if (ch == 'i') c = LETTER_I;
+                else if (ch == '\n') c = NEWLINE;
+                else if (isspace(ch)) c = SPACE;
+                else if (ch == '.' || ch == '?' || ch == '!') c = TERMINATOR;
+                classes[ch] = c;
+            }
+            const unsigned char table[4][CLASSES] = {
+                //                    OTHER    LETTER_I SPACE           NEWLINE         TERMINATOR
+                /* SENTENCE_START */ {IN_WORD, IN_WORD, SENTENCE_START, SENTENCE_START, SENTENCE_START},
+                /* WORD_GAP */       {IN_WORD, LONE_I,  WORD_GAP,       SENTENCE_START, SENTENCE_START},
+                /* IN_WORD */        {IN_WORD, IN_WORD, WORD_GAP,       SENTENCE_START, SENTENCE_START},
+                /* LONE_I */         {IN_WORD, IN_WORD, WORD_GAP,       SENTENCE_START, SENTENCE_START},
+            };
+            memcpy(next, table, sizeof(next));
+            for (int state = 0; state < 4; state++) {
+                for (int ch = 0; ch < 256; ch++) {
+                    unsigned char c = classes[ch];
+                    step[state][ch] = next[state][c];
+                    if (state == SENTENCE_START && ch >= 'a' && ch <= 'z') step[state][ch] |= UPPER;
+                    if (state == LONE_I && c >= SPACE) step[state][ch] |= FIX_I;
+                    steps[ch] |= step[state][ch] << (4 * state);
+                }
+            }
+        }
+    };
+
+    static const Tables& tables() {
+        static const Tables built;
+        return built;
+    }
+
+    State state;
+
+public:
+    explicit Capitalizer(State state = SENTENCE_START) : state(state) {}
+
+    State current() const { return state; }
+
+    // Would a letter typed now be capitalized?
+    bool capitalizesNext() const { return state == SENTENCE_START; }
+
+    // Take one typed character and return it as it should be inserted.
+    // fixI is set when it ends a lone "i" (the character before it), which
+    // then has to become "I".
+    char feed(char ch, bool& fixI) {
+        unsigned char step = tables().step[state][(unsigned char)ch];
+        fixI = (step & FIX_I) != 0;
+        state = (State)(step & STATE_BITS);
+        return (step & UPPER) ? ch ^ 0x20 : ch;
+    }
+
+    // The state after typing text[0, pos), where at(i) reads character i.
+    // Every character but a space or an "i" decides the state on its own, so
+    // only the run of those before pos is read again.
+    template <class At>
+    static State stateAt(const At& at, size_t pos) {
+        const Tables& t = tables();
+        size_t from = pos;
+        while (from > 0) {
+            unsigned char c = t.classes[(unsigned char)at(from - 1)];
+            if (c != SPACE && c != LETTER_I) break;
+            from--;
+        }
+        State state = SENTENCE_START;
+        if (from > 0) state = (State)t.next[IN_WORD][t.classes[(unsigned char)at(from - 1)]];
+        for (size_t i = from; i < pos; i++) state = (State)t.next[state][t.classes[(unsigned char)at(i)]];
+        return state;
+    }
+
+    static State stateAt(const TextBuffer& text, size_t pos) {
+        return stateAt([&](size_t i) { return text.at(i); }, pos);
+    }
+
+    // Write data[0, len) to out as typing it in 'state' would leave it, with
+    // 'next' the character after it (which may still fix a lone "i" at the
+    // end). out may be data. A lone "i" just before data is left to whoever
+    // writes that character. Returns the state after the text.
+    // The loop reads all four possible steps of a character at once and
+    // shifts out the one for the current state, so each character waits on a
+    // shift rather than on a table load that depends on the previous one.
+    static State capitalize(const char* data, char* out, size_t len, State state, int next = NONE) {
+        const uint16_t* steps = tables().steps;
+        unsigned shift = 4 * state;
+        for (size_t i = 0; i < len; i++) {
+            unsigned char ch = data[i];
+            unsigned v = steps[ch] >> shift;
+            out[i] = ch ^ ((v & UPPER) << 3); // 'a' ^ 0x20 == 'A'
+            if ((v & FIX_I) && i > 0) out[i - 1] = 'I';
+            shift = (v & STATE_BITS) << 2;
+        }
+        State after = (State)(shift >> 2);
+        if (len > 0 && next != NONE && (tables().step[after][(unsigned char)next] & FIX_I)) out[len - 1] = 'I';
+        return after;
+    }
+};
+
+// Capitalize a whole text on several threads, byte for byte as typing it
+// from the start of a document would. Each slice finds its starting state
+// from the few characters before it (Capitalizer::stateAt()) and fixes a
+// lone "i" at its end by looking at the character after it, so the slices
+// never write each other's bytes. out must not overlap data.
+void capitalizeParallel(const char* data, char* out, size_t len, unsigned threads = 0) {
+    forEachSlice(len, threads, [&](unsigned, size_t from, size_t to) {
+        Capitalizer::State state = Capitalizer::stateAt([&](size_t i) { return data[i]; }, from);
+        Capitalizer::capitalize(data + from, out + from, to - from, state,
+                                to < len ? (unsigned char)data[to] : Capitalizer::NONE);
+    });
+}
+//Auto-capitalization ends
+
+//Undo log starts
+// Undo history is a log of edits rather than copies of the document. Each
+// edit remembers what was removed and what was inserted at a position, so
+// undoing or redoing it costs O(edit size) whatever the document size.
+struct Edit {
+    size_t pos;        // Where the edit happened
+    string removed;    // Text that was there before
+    string inserted;   // Text that replaced it
+};
+
+// Everything one command (a key press) changed, undone and redone together
+struct UndoStep {
+    vector<Edit> edits;
+    size_t cursorBefore = 0;  // Cursor to restore on undo
+    size_t cursorAfter = 0;   // Cursor to restore on redo
+    TextStats statsAfter;     // The editor's statistics after the step (see TextEditor::stats)
+};
+
+// History is a tree of document versions rather than two stacks: typing after
+// an undo starts a new branch and the old one stays reachable. Each version
+// keeps the UndoStep from its parent, and with the rope engine also a snapshot
+// of the whole document. Rope nodes are immutable and shared, so a snapshot
+// costs only the nodes its edit copied (O(log n)), and jumping to it is O(1).
+//
+// Versions live in a fixed ring of UNDO_RING_CAPACITY slots in creation order
+// (version id % capacity). The history is limited by a memory budget in bytes:
+// when a new version pushes it over, the oldest versions are evicted from the
+// front of the ring in O(1) each. A version is always newer than its parent,
+// so eviction only ever cuts off the oldest ancestors.
+class UndoTree {
+public:
+    struct Version {
+        int parent = -1;        // Version this one was made from
+        vector<int> children;   // Versions made from this one, oldest first
+        int redoChild = -1;     // Child that redo goes to (the last one visited)
+        int depth = 0;          // Distance from the first version
+        UndoStep step;          // Edits that turn the parent into this version
+        bool hasSnapshot = false;
+        Rope snapshot;          // Whole document at this version (rope engine only)
+        size_t bytes = 0;       // Memory charged to this version
+    };
+
+private:
+    vector<Version> ring;       // Slot id % ring.size() holds version id
+    int firstId = 0;            // Oldest version still kept
+    int nextId = 0;             // Id the next version gets
+    int current = 0;
+    size_t budget = DEFAULT_UNDO_BUDGET;
+    size_t bytesUsed = 0;
+
+    Version& slot(int id) { return ring[id % ring.size()]; }
+
+    static size_t stepBytes(const UndoStep& step) {
+        size_t bytes = sizeof(Version) + step.edits.capacity() * sizeof(Edit);
+        for (const Edit& e : step.edits) bytes += e.removed.capacity() + e.inserted.capacity();
+        return bytes;
+    }
+
+    // Drop the oldest version, O(1) apart from freeing its own edits
+    void evictOldest() {
+        Version& oldest = slot(firstId);
+        bytesUsed -= oldest.bytes;
+        oldest = Version();
+        firstId++;
+    }
+
+public:
+    UndoTree() : ring(UNDO_RING_CAPACITY) {}
+
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t memoryBudget() const { return budget; }
+    size_t memoryUsed() const { return bytesUsed; }
+    int versionCount() const { return nextId - firstId; }
+
+    // Start over with a single version holding the document as it is now
+    void reset(const Rope* snapshot) {
+        for (Version& v : ring) v = Version();
+        firstId = current = 0;
+        nextId = 1;
+        Version& first = slot(0);
+        if (snapshot) {
+            first.hasSnapshot = true;
+            first.snapshot = *snapshot;
+        }
+        first.bytes = sizeof(Version);
+        bytesUsed = first.bytes;
+    }
+
+    bool contains(int id) const { return id >= firstId && id < nextId; }
+    Version& get(int id) { return slot(id); }
+    int currentId() const { return current; }
+    void setCurrent(int id) { current = id; }
+
+    // Parent of a version, or -1 if it is the oldest one kept
+    int parentOf(int id) {
+        int parent = get(id).parent;
+        return contains(parent) ? parent : -1;
+    }
+
+    // Add the version made by 'step' as a child of the current one
+    void add(UndoStep step, const Rope* snapshot) {
+        // Make room: the ring is full, or the budget is used up
+        while (versionCount() >= (int)ring.size() && firstId != current) evictOldest();
+        if (versionCount() >= (int)ring.size()) {
+            // Rare case: the ring is full and the current version is the oldest
+            // one kept, so everything else is its redo history. Drop that.
+            for (int id = current + 1; id < nextId; id++) {
+                bytesUsed -= slot(id).bytes;
+                slot(id) = Version();
+            }
+            nextId = current + 1;
+            get(current).children.clear();
+            get(current).redoChild = -1;
+        }
+
+        int id = nextId++;
+        Version& version = slot(id);
+        version = Version();
+        version.parent = current;
+        version.depth = get(current).depth + 1;
+        version.step = move(step);
+        version.bytes = stepBytes(version.step) + sizeof(int); // Plus its id in the parent's children
+        if (snapshot) {
+            version.hasSnapshot = true;
+            version.snapshot = *snapshot; // Shares every node with the live document
+            version.bytes += snapshot->editBytes();
+        }
+        bytesUsed += version.bytes;
+        get(current).children.push_back(id);
+        get(current).redoChild = id;
+        current = id;
+
+        // Stay within the memory budget: forget the oldest versions first
+        while (bytesUsed > budget && firstId != current) evictOldest();
+    }
+};
+//Undo log ends
+
+//Change tracking starts
+// Which part of the document changed since a consumer last looked, kept up
+// to date in O(1) per edit: the first changed byte and the range of changed
+// lines. An edit that adds or removes a '\n' moves every later line, so the
+// range then runs to the end of the document.
+struct ChangeSet {
+    static const size_t TO_END = SIZE_MAX;
+    bool any = false;
+    size_t firstByte = TO_END;  // Lowest changed offset
+    size_t firstLine = TO_END;  // First changed line
+    size_t lastLine = 0;        // Last changed line, TO_END if later lines moved
+
+    void add(size_t pos, size_t line, bool linesMoved) {
+        any = true;
+        firstByte = min(firstByte, pos);
+        firstLine = min(firstLine, line);
+        lastLine = linesMoved ? TO_END : max(lastLine, line);
+    }
+
+    void addAll() { add(0, 0, true); }
+    void clear() { *this = ChangeSet(); }
+};
+//Change tracking ends
+
+//Durable file output starts
+// Buffered output file whose contents can be forced to disk with sync().
+// Uses the OS file API directly because streams cannot fsync.
+// Outside Windows, a file that is written from the start (not appended to)
+// hands each full buffer to AsyncIO and keeps filling the next one while
+// up to QUEUE_DEPTH buffers are being written; large blocks are written
+// straight from the caller's memory.
+class OutputFile {
+private:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+    bool appending = false;
+    uint64_t position = 0;      // Where the next buffer goes
+    AsyncIO io;
+    deque<string> inFlight;     // Buffers AsyncIO is writing
+    vector<string> spare;       // Written buffers kept for reuse
+#endif
+    string pending;             // Bytes not handed to the OS yet
+    bool failed = false;        // A write, sync or close went wrong since open()
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    void drain() {
+#ifndef _WIN32
+        if (!appending) {
+            if (pending.empty()) return;
+            inFlight.push_back(string());
+            inFlight.back().swap(pending);
+            io.write(fd, inFlight.back().data(), inFlight.back().size(), position);
+            position += inFlight.back().size();
+            if (!spare.empty()) {
+                pending.swap(spare.back());
+                spare.pop_back();
+            }
+            if (inFlight.size() >= AsyncIO::QUEUE_DEPTH) settle();
+            return;
+        }
+#endif
+        size_t done = 0;
+        while (done < pending.size()) {
+#ifdef _WIN32
+            DWORD n = 0;
+            if (!WriteFile(handle, pending.data() + done, (DWORD)(pending.size() - done), &n, NULL) || n == 0) {
+                failed = true;
+                break;
+            }
+#else
+            ssize_t n = ::write(fd, pending.data() + done, pending.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                failed = true;
+                break;
+            }
+#endif
+            done += n;
+        }
+        pending.clear();
+    }
+
+    // Wait for the buffers being written in the background
+    void settle() {
+#ifndef _WIN32
+        if (!io.wait()) failed = true;
+        for (string& buffer : inFlight) {
+            buffer.clear();
+            spare.push_back(move(buffer));
+        }
+        inFlight.clear();
+#endif
+    }
+
+public:
+    ~OutputFile() { close(); }
+
+    // Open for writing, either emptying the file or appending to it
+    bool open(const string& path, bool append) {
+        close();
+        failed = false;
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                             append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle != INVALID_HANDLE_VALUE && append) SetFilePointer(handle, 0, NULL, FILE_END);
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+        appending = append;
+        position = 0;
+        return fd >= 0;
+#endif
+    }
+
+    bool isOpen() const {
+#ifdef _WIN32
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    // Each of these returns false once anything written since open() failed
+    // (a full disk, an I/O error); the error sticks until the next open()
+    bool write(const char* data, size_t len) {
+#ifndef _WIN32
+        if (!appending && len >= BUFFER_SIZE) {
+            drain();
+            io.write(fd, data, len, position);
+            position += len;
+            settle();
+            return !failed;
+        }
+#endif
+        pending.append(data, len);
+        if (pending.size() >= BUFFER_SIZE) drain();
+        return !failed;
+    }
+    bool write(const string& text) { return write(text.data(), text.size()); }
+
+    // Hand everything written so far to the OS
+    bool flush() {
+        drain();
+        return !failed;
+    }
+
+    // Flush and wait until the data is on disk
+    bool sync() {
+        drain();
+        settle();
+#ifdef _WIN32
+        if (!FlushFileBuffers(handle)) failed = true;
+#else
+        if (fsync(fd) != 0) failed = true;
+#endif
+        return !failed;
+    }
+
+    bool close() {
+        if (!isOpen()) return !failed;
+        drain();
+        settle();
+#ifdef _WIN32
+        if (!CloseHandle(handle)) failed = true;
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (::close(fd) != 0) failed = true;
+        fd = -1;
+#endif
+        return !failed;
+    }
+};
+
+// Overwrite the existing file from 'offset' on with data, cut it off right
+// after, and wait until that is on disk. Positional writes: the bytes before
+// 'offset' are not touched at all.
+bool patchFile(const string& path, uint64_t offset, const string& data) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER at;
+    at.QuadPart = offset;
+    bool ok = SetFilePointerEx(handle, at, NULL, FILE_BEGIN) != 0;
+    size_t done = 0;
+    while (ok && done < data.size()) {
+        DWORD n = 0;
+        ok = WriteFile(handle, data.data() + done, (DWORD)min<size_t>(data.size() - done, 1 << 30), &n, NULL) != 0;
+        done += n;
+    }
+    ok = ok && SetEndOfFile(handle) && FlushFileBuffers(handle);
+    CloseHandle(handle);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0) return false;
+    AsyncIO io;
+    io.write(fd, data.data(), data.size(), offset);
+    bool ok = io.wait() && ftruncate(fd, offset + data.size()) == 0 && fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Make a rename in the directory of 'path' survive a crash. POSIX stores the
+// directory entry separately from the file; Windows needs nothing extra.
+void syncDirectory(const string& path) {
+#ifndef _WIN32
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : path.substr(0, max<size_t>(slash, 1));
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#endif
+}
+//Durable file output ends
+
+//Edit journal starts
+// Size and last write time of a file, to tell later whether it is still the
+// file a journal was started against. Both are 0 if it does not exist. The
+// time is kept at full resolution (nanoseconds, or 100 ns ticks on Windows):
+// a file rewritten within the same second must not pass for the old one.
+void fileStamp(const string& path, uint64_t& size, uint64_t& stamp) {
+    size = stamp = 0;
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) return;
+    size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    stamp = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return;
+    size = info.st_size;
+    stamp = (uint64_t)info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec;
+#endif
+}
+
+// Append-only log of the edits made since the document was last written in
+// full. A key press appends one small record instead of rewriting the whole
+// file; the document file plus the journal always give the current text.
+// Layout: "TEJ1", base file size and stamp (u64 each), then per edit
+// 'E', pos, removed length, inserted length (u64 each), the removed and
+// inserted bytes, and a u64 hash of the record so a torn tail can be detected.
+// A 'W' record has the same layout and holds the new file contents from
+// offset 'pos' on, logged before the document is patched in place; its
+// "removed" bytes are the hash and length (u64 each) of the CHECKPOINT_WINDOW
+// bytes of the file just before 'pos', which the patch leaves alone.
+// The undo history is journaled too, so a crash loses neither: an 'S' record
+// closes an undo step (pos is the cursor before it, the inserted bytes hold
+// the u64 cursor after it), and 'U', 'R' and 'B' mark an undo, a redo and a
+// branch switch, logged after the edits that took the text there.
+// Records are encoded by the editor and written by the background saver.
+class EditJournal {
+private:
+    string path;
+    OutputFile out;
+    size_t written = 0;         // Bytes in the journal file
+
+    static void putU64(string& rec, uint64_t v) { rec.append((const char*)&v, sizeof(v)); }
+
+    static string encode(char type, size_t pos, const string& removed, const string& inserted) {
+        string rec(1, type);
+        putU64(rec, pos);
+        putU64(rec, removed.size());
+        putU64(rec, inserted.size());
+        rec += removed;
+        rec += inserted;
+        putU64(rec, hashAppend(0, rec.data(), rec.size()));
+        return rec;
+    }
+
+    // Decode the record at 'at'. Returns the offset after it, or 0 if it is
+    // damaged or incomplete (a crash while appending).
+    static size_t decode(const string& data, size_t at, char& type, uint64_t& pos, string& removed, string& inserted) {
+        const size_t FIXED = 1 + 3 * sizeof(uint64_t); // Type and the three numbers
+        if (data.size() - at < FIXED + sizeof(uint64_t)) return 0;
+        uint64_t removedLen = getU64(data, at + 1 + sizeof(uint64_t));
+        uint64_t insertedLen = getU64(data, at + 1 + 2 * sizeof(uint64_t));
+        size_t room = data.size() - at - FIXED - sizeof(uint64_t);
+        if (removedLen > room || insertedLen > room - removedLen) return 0;
+        size_t end = at + FIXED + removedLen + insertedLen;
+        if (getU64(data, end) != hashAppend(0, data.data() + at, end - at)) return 0;
+        type = data[at];
+        pos = getU64(data, at + 1);
+        removed = data.substr(at + FIXED, removedLen);
+        inserted = data.substr(at + FIXED + removedLen, insertedLen);
+        return end + sizeof(uint64_t);
+    }
+
+    // The journal at 'path', or "" if there is none or it is not a journal
+    static string load(const string& path) {
+        string data;
+        if (!readWholeFile(path, data)) return "";
+        if (data.size() < HEADER_SIZE || data.compare(0, 4, "TEJ1") != 0) return "";
+        return data;
+    }
+
+public:
+    static const size_t HEADER_SIZE = 4 + 2 * sizeof(uint64_t);
+
+    static uint64_t getU64(const string& data, size_t at) {
+        uint64_t v;
+        memcpy(&v, data.data() + at, sizeof(v));
+        return v;
+    }
+
+    // The record for replacing [pos, pos + removed.size()) with inserted
+    static string record(size_t pos, const string& removed, const string& inserted) {
+        return encode('E', pos, removed, inserted);
+    }
+
+    // The record closing an undo step
+    static string stepEnd(size_t cursorBefore, size_t cursorAfter) {
+        string after;
+        putU64(after, cursorAfter);
+        return encode('S', cursorBefore, "", after);
+    }
+
+    // The record for an undo ('U'), redo ('R') or branch switch ('B')
+    static string historyMove(char move) {
+        return encode(move, 0, "", "");
+    }
+
+    // The record for rewriting the document file from 'offset' on with tail;
+    // 'before' is the text just before 'offset' (see CHECKPOINT_WINDOW)
+    static string checkpoint(size_t offset, const string& before, const string& tail) {
+        string check;
+        putU64(check, hashAppend(0, before.data(), before.size()));
+        putU64(check, before.size());
+        return encode('W', offset, check, tail);
+    }
+
+    // Does 'document' still hold the bytes a 'W' record at 'offset' was
+    // checked against? A patch that was cut short has changed the file's
+    // size and time, but never these bytes.
+    static bool checkpointFits(const string& document, uint64_t offset, const string& check) {
+        if (check.size() != 2 * sizeof(uint64_t)) return false;
+        uint64_t length = getU64(check, sizeof(uint64_t));
+        if (length > offset) return false;
+        ifstream in(document, ios::binary);
+        string before(length, '\0');
+        in.seekg(offset - length);
+        if (!in.read(&before[0], length)) return false;
+        return hashAppend(0, before.data(), before.size()) == getU64(check, 0);
+    }
+
+    // If the journal at 'path' holds a complete 'W' record, a patch of
+    // 'document' may have been cut short: write it again. Only if the journal
+    // belongs to this file: its header matches the file (the patch had not
+    // started yet), or the bytes before the patch are the ones the record
+    // was checked against. Records after the
+    // last 'W' (edits made after a patch that failed) are kept as a new
+    // journal on top of the patched file; without any the journal is removed.
+    // True if it patched the document.
+    static bool redoCheckpoint(const string& path, const string& document) {
+        string data = load(path);
+        if (data.empty()) return false;
+        uint64_t baseSize, baseStamp;
+        fileStamp(document, baseSize, baseStamp);
+        bool sameFile = getU64(data, 4) == baseSize && getU64(data, 12) == baseStamp;
+        char type;
+        uint64_t pos;
+        string removed, inserted;
+        bool found = false;
+        uint64_t offset = 0;
+        string tail, check;
+        size_t afterCheckpoint = 0, end = HEADER_SIZE; // Records after the last 'W'
+        while (end < data.size()) {
+            size_t next = decode(data, end, type, pos, removed, inserted);
+            if (next == 0) break;
+            if (type == 'W') {
+                found = true;
+                offset = pos;
+                tail.swap(inserted);
+                check.swap(removed);
+                afterCheckpoint = next;
+            }
+            end = next;
+        }
+        if (!found || !(sameFile || checkpointFits(document, offset, check))) return false;
+        if (!patchFile(document, offset, tail)) return false;
+        if (afterCheckpoint == end) {
+            remove(path.c_str());
+            return true;
+        }
+        // Written aside and renamed, so a crash leaves either journal intact
+        fileStamp(document, baseSize, baseStamp);
+        string header = "TEJ1";
+        putU64(header, baseSize);
+        putU64(header, baseStamp);
+        OutputFile file;
+        string tempName = path + ".tmp";
+        bool ok = file.open(tempName, false) && file.write(header) &&
+                  file.write(data.data() + afterCheckpoint, end - afterCheckpoint) && file.sync();
+        ok = file.close() && ok;
+        if (!ok || !replaceFile(tempName, path)) remove(tempName.c_str()); // The old one is redone next time
+        return true;
+    }
+
+    // Apply the edits in the journal at 'path' to text, which holds 'document'
+    // as it is on disk, and pass every record used (edits after they are
+    // applied) to 'seen'. A journal written against another version of the
+    // file is ignored. Replay stops at the first damaged or incomplete record
+    // (a crash while appending), but a record that does not fit the text
+    // means the journal belongs to some other file, so the records are first
+    // tried out on text and taken back again: if one does not fit, nothing of
+    // the journal is used. Returns the length of the journal up to the last
+    // record used, or 0 if there is no usable journal.
+    static size_t replay(const string& path, const string& document, TextBuffer& text,
+                         const function<void(char, uint64_t, const string&, const string&)>& seen) {
+        string data = load(path);
+        if (data.empty()) return 0;
+        uint64_t baseSize, baseStamp;
+        fileStamp(document, baseSize, baseStamp);
+        if (getU64(data, 4) != baseSize || getU64(data, 12) != baseStamp) return 0;
+
+        struct Record {
+            char type;
+            uint64_t pos;
+            string removed, inserted;
+        };
+        vector<Record> used;    // Tried out so far
+        size_t usedLength = HEADER_SIZE;
+        bool mismatch = false;
+        while (usedLength < data.size()) {
+            Record r;
+            size_t next = decode(data, usedLength, r.type, r.pos, r.removed, r.inserted);
+            if (next == 0) break;
+            if (r.type == 'E') {
+                if (r.pos + r.removed.size() > text.size() || text.substr(r.pos, r.pos + r.removed.size()) != r.removed) {
+                    mismatch = true;
+                    break;
+                }
+                text.replace(r.pos, r.removed.size(), r.inserted);
+            } else if (r.type == 'S' ? r.inserted.size() != sizeof(uint64_t) : (r.type != 'U' && r.type != 'R' && r.type != 'B')) {
+                mismatch = true;
+                break;
+            }
+            used.push_back(move(r));
+            usedLength = next;
         }
-        return node->isEndOfWord;
+        for (size_t i = used.size(); i-- > 0;) {
+            const Record& r = used[i];
+            if (r.type == 'E') text.replace(r.pos, r.inserted.size(), r.removed);
+        }
+        if (mismatch) return 0;
+        for (const Record& r : used) {
+            if (r.type == 'E') text.replace(r.pos, r.removed.size(), r.inserted);
+            seen(r.type, r.pos, r.removed, r.inserted);
+        }
+        return usedLength;
     }
 
-    // Collect suggestions
-    void collectSuggestions(TrieNode* node, string& prefix, vector<string>& suggestions) {
-        if (node->isEndOfWord) {
-            suggestions.push_back(prefix);
+    void setPath(const string& p) { path = p; }
+    bool isOpen() const { return out.isOpen(); }
+    size_t size() const { return written; }
+
+    // Carry on with the journal an earlier session left, of which the first
+    // 'length' bytes were replayed: cut off anything after them (a torn
+    // record) and append to it
+    bool resume(size_t length) {
+        if (!patchFile(path, length, "") || !out.open(path, true)) return false;
+        written = length;
+        return true;
+    }
+
+    // Start a new, empty journal on top of the document file as it is now
+    bool start(const string& document) {
+        uint64_t baseSize, baseStamp;
+        fileStamp(document, baseSize, baseStamp);
+        string header = "TEJ1";
+        putU64(header, baseSize);
+        putU64(header, baseStamp);
+        written = header.size();
+        return out.open(path, false) && out.write(header) && out.flush();
+    }
+
+    // Append encoded records and push them to the OS
+    bool write(const string& records) {
+        written += records.size();
+        return out.write(records) && out.flush();
+    }
+
+    // Wait until everything appended is on disk
+    bool sync() { return out.sync(); }
+
+    // The document was written in full: the journal is no longer needed
+    void discard() {
+        out.close();
+        remove(path.c_str());
+        written = 0;
+    }
+};
+//Edit journal ends
+
+//Background saver starts
+// Write the text and the word count footer to 'filename'. The text goes to a
+// temporary file that is synced and then renamed over the document, so after
+// a crash the document is either the old or the new version, never a torn
+// one. This also keeps an opened document, still memory-mapped by the piece
+// table, from being truncated underneath it.
+// Line gaps between the text and the live word count that end every saved file
+string documentFooter(long long words) {
+    return "\n\n\n\n\nCurrent Word Count: " + to_string(words) + "\n";
+}
+
+// Returns false if anything failed, in which case the document is untouched.
+bool writeDocument(const TextView& text, long long words, const string& filename) {
+    string tempName = filename + ".tmp";
+    OutputFile file;
+    if (!file.open(tempName, false)) return false;
+    // The buffer already holds the text in order, lines separated by '\n'
+    text.forEachChunk(0, text.size(), [&](const char* data, size_t len) { file.write(data, len); });
+    bool ok = file.write(documentFooter(words)) && file.sync();
+    ok = file.close() && ok;
+    if (!ok || !replaceFile(tempName, filename)) {
+        remove(tempName.c_str());
+        return false;
+    }
+    syncDirectory(filename);
+    return true;
+}
+
+// Work handed from the editor to the saver
+struct SaveJob {
+    unique_ptr<TextView> snapshot; // Whole document to write, if any
+    size_t dirtyFrom = 0;       // Lowest byte of the snapshot that differs from the file
+    bool inPlace = false;       // May the file be patched in place (nothing reads it from dirtyFrom on)?
+    long long words = 0;        // Word count for the snapshot's footer
+    shared_future<TextStats> openedStats; // If the opened file was still being counted: add its words
+    string covered;             // Journal records of edits the snapshot holds, only written if saving it fails
+    string records;             // Journal records for edits made after the snapshot
+    string suggestions;         // Spell check results to append to SUGGESTIONS_FILE
+};
+
+// Does all file I/O on its own thread so a slow disk never stalls typing. The
+// editor hands over work through a single atomic slot without locking: a job
+// that the saver has not picked up yet is merged with the next one, so a
+// burst of key presses becomes one journal write per interval, and a new
+// snapshot replaces everything queued before it. Snapshots are taken in O(1)
+// or O(pieces) (TextBuffer::snapshot()); reading the text out of them and
+// writing it happens here.
+// A snapshot whose changes are confined to the end of the document only
+// rewrites the file from its first dirty byte (see patchDocument()).
+// Full rewrites are always synced (they are rare). Journal appends are
+// synced by policy: every N seconds, FSYNC_ON_IDLE or FSYNC_ON_EXIT.
+// If a save fails (a full disk, an I/O error) the journal is kept, together
+// with the records of the edits that save held, and the next save rewrites
+// the whole file.
+class AutoSaver {
+private:
+    string filename;
+    EditJournal journal;
+    chrono::milliseconds interval{DEFAULT_SAVE_INTERVAL_MS};
+    int fsyncPolicy = FSYNC_ON_IDLE;
+    bool unsynced = false;      // Journal records not known to be on disk
+    bool saveFailed = false;    // The file is not what the editor last saved
+    chrono::steady_clock::time_point lastSync;
+    atomic<SaveJob*> pending{nullptr};
+    atomic<bool> stopping{false};
+    mutex sleepLock;            // Only used to sleep between rounds
+    condition_variable wakeUp;
+    thread worker;
+
+    void process(SaveJob* job) {
+        if (job->snapshot) {
+            const TextView& text = *job->snapshot;
+            size_t from = min(job->dirtyFrom, text.size());
+            // Waiting for the count here keeps the editor from ever waiting for it
+            long long words = job->words + (job->openedStats.valid() ? job->openedStats.get().words : 0);
+            bool checkpointed = false;
+            bool saved = job->inPlace && !saveFailed && (text.size() - from) * 2 < text.size()
+                             ? patchDocument(text, words, from, checkpointed)
+                             : writeDocument(text, words, filename);
+            if (saved) {
+                journal.discard(); // Also one left by an earlier session
+                unsynced = false;
+            } else if (!checkpointed) {
+                // The document is as it was: the journal has to hold these edits
+                if (!journal.isOpen()) journal.start(filename);
+                journal.write(job->covered);
+                unsynced = true;
+            } // else the logged checkpoint holds them: opening the document redoes it
+            saveFailed = !saved;
         }
-        for (int i = 0; i < 26 && suggestions.size() < 5; ++i) {  // Stop after 5 suggestions
-            if (node->children[i] != nullptr) {
-                prefix.push_back('a' + i);
-                collectSuggestions(node->children[i], prefix, suggestions);
-                prefix.pop_back();
-            }
+        if (!job->records.empty()) {
+            if (!journal.isOpen()) journal.start(filename); // First edit since the document was written
+            journal.write(job->records);
+            unsynced = true;
         }
+        if (!job->suggestions.empty()) {
+            ofstream outFile(SUGGESTIONS_FILE, ios::app);  // Open in append mode to keep adding results
+            outFile << job->suggestions;
+        }
+        delete job;
     }
 
-    // Get suggestions for a word
-    vector<string> getSuggestions(const string& prefix) {
-        TrieNode* node = root;
-        vector<string> suggestions;
-        for (char ch : prefix) {
-            int index = ch - 'a';
-            if (node->children[index] == nullptr) {
-                return suggestions;  // No suggestions found
+    // Rewrite the document from byte 'from' on, in place, so appending to a
+    // large document costs the size of the new tail rather than the file.
+    // The tail is synced into the journal first: if the patch is cut short,
+    // opening the document redoes it (EditJournal::redoCheckpoint()).
+    // 'checkpointed' tells whether the tail made it into the journal.
+    bool patchDocument(const TextView& text, long long words, size_t from, bool& checkpointed) {
+        string tail = text.substr(from, text.size()) + documentFooter(words);
+        if (!journal.isOpen()) journal.start(filename);
+        string before = text.substr(from - min(from, CHECKPOINT_WINDOW), from);
+        checkpointed = journal.write(EditJournal::checkpoint(from, before, tail)) && journal.sync();
+        if (checkpointed && patchFile(filename, from, tail)) return true;
+        return writeDocument(text, words, filename);
+    }
+
+    void syncJournal() {
+        if (unsynced && journal.isOpen()) journal.sync();
+        unsynced = false;
+        lastSync = chrono::steady_clock::now();
+    }
+
+    void run() {
+        lastSync = chrono::steady_clock::now();
+        while (!stopping) {
+            {
+                unique_lock<mutex> lock(sleepLock);
+                wakeUp.wait_for(lock, interval, [this] { return stopping.load(); });
             }
-            node = node->children[index];
+            SaveJob* job = pending.exchange(nullptr);
+            if (job) process(job);
+            if (!unsynced) continue;
+            if (fsyncPolicy > 0 && chrono::steady_clock::now() - lastSync >= chrono::seconds(fsyncPolicy)) syncJournal();
+            else if (fsyncPolicy == FSYNC_ON_IDLE && !job) syncJournal(); // Nothing came in for a whole interval
         }
-        collectSuggestions(node, const_cast<string&>(prefix), suggestions);
-        return suggestions;
+        if (SaveJob* job = pending.exchange(nullptr)) process(job); // Whatever came in last
+        syncJournal();
     }
-};
 
-// Load dictionary into Trie
-void loadDictionary(Trie& trie, const string& dictionaryFile) {
-    ifstream dictFile(dictionaryFile);
-    string word;
-    while (getline(dictFile, word)) {
-        trie.insert(word);
+public:
+    ~AutoSaver() { finish(); }
+
+    // Keep appending to the journal left by an earlier session, whose first
+    // 'length' bytes the editor replayed, instead of rewriting the document.
+    // Call before start().
+    bool resumeJournal(const string& document, size_t length) {
+        journal.setPath(document + ".journal");
+        return journal.resume(length);
     }
-    dictFile.close();
-}
 
-void spellcheckAndSuggest(Trie& trie, const string& word, const string& outputFile) {
-    ofstream outFile(outputFile, ios::app);  // Open in append mode to keep adding results
-    
-    string processedWord = word;
-    // Remove punctuation if any
-    processedWord.erase(remove_if(processedWord.begin(), processedWord.end(), ::ispunct), processedWord.end());
-    transform(processedWord.begin(), processedWord.end(), processedWord.begin(), ::tolower);
-    
-    if (!trie.search(processedWord)) {
-        outFile << processedWord << " Did you mean?\n";
-        vector<string> suggestions = trie.getSuggestions(processedWord.substr(0, 2));  // Use first 2 letters for suggestions
-        int suggestionCount = 0;
-        for (const string& suggestion : suggestions) {
-            outFile << suggestion << " ";
-            if (++suggestionCount >= 5) break;  // Limit to top 5 suggestions
-        }
-        outFile << "\n\n";
+    void start(const string& document, int intervalMs, int fsync) {
+        filename = document;
+        journal.setPath(document + ".journal");
+        interval = chrono::milliseconds(intervalMs);
+        fsyncPolicy = fsync;
+        worker = thread(&AutoSaver::run, this);
     }
-    
-    outFile.close();
-}
 
-Trie trie;
-//Spellchecker code meat ends
+    // Editor side, never blocks. Only the editor puts jobs into the slot, so
+    // after taking the queued job back the slot stays empty until the store.
+    void submit(SaveJob* job) {
+        if (SaveJob* queued = pending.exchange(nullptr)) {
+            if (job->snapshot) {
+                // The snapshot already contains those edits; a snapshot the
+                // saver never wrote leaves its dirty bytes to this one, and
+                // patching from there must have been allowed for both
+                if (queued->snapshot) {
+                    job->dirtyFrom = min(job->dirtyFrom, queued->dirtyFrom);
+                    job->inPlace = job->inPlace && queued->inPlace;
+                }
+                job->covered = queued->covered + queued->records + job->covered;
+                job->suggestions = queued->suggestions + job->suggestions;
+                delete queued;
+            } else {
+                queued->records += job->records;
+                queued->suggestions += job->suggestions;
+                delete job;
+                job = queued;
+            }
+        }
+        pending.store(job);
+    }
 
+    // Write everything still queued and stop the thread (on exit)
+    void finish() {
+        if (!worker.joinable()) return;
+        {
+            lock_guard<mutex> lock(sleepLock);
+            stopping = true;
+        }
+        wakeUp.notify_one();
+        worker.join();
+    }
+};
+//Background saver ends
 
-long long int Word_Count = 0;   //Set initial word count as 0
-const vector<int> Colours = {7,9,12,13,14};  //Default : 7(white)
-                                                //Blue : 9
-                                                //Red : 12
-                                                //Magenta : 13
-                                                //Yellow : 14                                                                                               
-auto Colour_Itr = Colours.begin();    //To iterate through colours
+// Command line settings for a TextEditor
+struct EditorOptions {
+    string engine;              // "rope", "gap" or "piece"; empty picks the default
+    size_t undoBudget = DEFAULT_UNDO_BUDGET;
+    int saveInterval = DEFAULT_SAVE_INTERVAL_MS;
+    int fsyncPolicy = FSYNC_ON_IDLE;
+};
 
 class TextEditor {
 private:
-    stack<char> leftStack;   // Stores the text to the left of the cursor
-    stack<char> rightStack;  // Stores the text to the right of the cursor
-    vector<stack<char>> lines;  // Each line is a separate stack
+    unique_ptr<TextBuffer> buffer; // Whole document (gap buffer or piece table)
+    size_t cursor = 0;          // Byte offset of the cursor in the document
     int currentLine = 0;        // Track which line the cursor is on
     int cursorX = 0, cursorY = 0; // Tracks the cursor's x and y position (for console display)
+    Viewport view;                // Lines and columns on the screen
 
-    vector<vector<stack<char>>> undoStack; // Undo stack to store previous states
-    vector<vector<stack<char>>> redoStack; // Redo stack for redo functionality
+    UndoTree history;           // Every version of the document, with undo branches
+    AutoSaver saver;            // Writes the document and its journal in the background
+    string unsentRecords;       // Journal records not handed to the saver yet
+    size_t journalBytes = 0;    // Journal records handed over since the last full write
+    UndoStep pendingStep;       // Edits of the command currently running
+    ChangeSet screenChanges;    // Lines changed since the screen was last drawn
+    ChangeSet fileChanges;      // Bytes changed since the document was last written
+    size_t drawnCursor = SIZE_MAX; // Cursor position on the last drawn screen
+    Viewport drawnView;           // The view of the last drawn screen
+    bool drawn = false;           // Has a frame been drawn yet?
+    int drawnCursorLine = -1;     // Line that shows the cursor mark and suggestion
+    ScreenBuffer screen;          // What the console shows and the next frame
+    string cursorWord, statusText; // Reused by every frame
+    uint64_t savedVersion = UINT64_MAX; // buffer->version() when the file was last written
+    uint64_t savedHash = 0;     // buffer->contentHash() when the file was last written
+    TextStats stats;            // Statistics, adjusted on every edit in O(edit). For an opened
+                                // piece table they leave out the file's own text (openedStats).
+    shared_future<TextStats> openedStats; // Statistics of the file a piece table opened, counted on another thread
+    TextStats openedTextStats;
+    Capitalizer capitals;       // Capitalization state at capitalsAt, carried from key to key
+    size_t capitalsAt = SIZE_MAX;
+    uint64_t capitalsVersion = 0; // buffer->version() the state belongs to
+    Rope clipboard;           // Text cut or copied with Ctrl+X / Ctrl+C
     string filename;
     unordered_map<string,string> autocompleteWords = {
     {"add", "address"},
@@ -264,134 +3659,327 @@ private:
 };
 
 
-    // Helper function to set cursor position in the console
-    void setCursorPosition(int x, int y) {
-        COORD coord;
-        coord.X = x;
-        coord.Y = y;
-        SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), coord);
+    // Recompute the console cursor (line/column) from the gap position
+    void syncCursor() {
+        size_t start = buffer->lineStart(cursor);
+        currentLine = buffer->countLines(start);
+        cursorX = cursor - start;
+        cursorY = currentLine;
     }
 
-    
-// Helper function to display the current text
-void displayText() {
-    system("cls"); // Clear the console
-    for (int i = 0; i < lines.size(); i++) {
-        stack<char> temp = lines[i];
-        stack<char> reversedStack;
+    // Remember an edit that was just made, as part of the current command
+    void recordEdit(size_t pos, const string& removed, const string& inserted) {
+        if (pendingStep.edits.empty()) pendingStep.cursorBefore = cursor;
+        pendingStep.edits.push_back({pos, removed, inserted});
+    }
 
-        // Reverse the stack to maintain original order of characters
-        while (!temp.empty()) {
-            reversedStack.push(temp.top());
-            temp.pop();
-        }
+    // Note a change at pos before it is made, for the screen and the save path
+    void noteChange(size_t pos, size_t len, const string& text) {
+        size_t line = buffer->countLines(pos);
+        bool linesMoved = text.find('\n') != string::npos || (len > 0 && (size_t)buffer->countLines(pos + len) != line);
+        screenChanges.add(pos, line, linesMoved);
+        fileChanges.add(pos, line, linesMoved);
+    }
 
-        // Print the line
-        while (!reversedStack.empty()) {
-            cout << reversedStack.top();
-            reversedStack.pop();
-        }
+    // Log a change for the journal; updateTextFile() hands it to the saver
+    void journalEdit(size_t pos, const string& removed, const string& inserted) {
+        unsentRecords += EditJournal::record(pos, removed, inserted);
+    }
 
-        // Check for autocomplete suggestion
-        if (i == currentLine) {
-            // Check if there's a suggestion
-            string str = "";
-            stack<char> tempStack = leftStack;
-            while (!tempStack.empty() && tempStack.top() != ' ') {
-                str += tempStack.top();
-                tempStack.pop();
-            }
-            reverse(str.begin(), str.end());
-            if (autocompleteWords.find(str) != autocompleteWords.end()) {
-                // Display the suggestion in a different color
-                SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), SUGGESTION_COLOR);
-                cout << " *"; // Asterisk indicating an autocomplete suggestion
-                cout << " " << autocompleteWords[str]; // Show the suggestion
-                SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), DEFAULT_COLOR); // Reset color
-            }
+    // Adjust the statistics for replacing [pos, pos + removed.size()) with
+    // text, before the edit is made
+    void countEdit(size_t pos, const string& removed, const string& text) {
+        stats += statsChange(*buffer, pos, removed.size(), removed, text);
+    }
 
-            cout << "_"; // Cursor position
-            temp = rightStack;
-            while (!temp.empty()) {
-                cout << temp.top();
-                temp.pop();
-            }
-        }
-        cout << endl; // Move to the next line
+    // Every change to the text goes through here so change tracking, the
+    // statistics and the journal see it
+    void replaceText(size_t pos, const string& removed, const string& text) {
+        noteChange(pos, removed.size(), text);
+        countEdit(pos, removed, text);
+        journalEdit(pos, removed, text);
+        buffer->replace(pos, removed.size(), text);
     }
 
-    // Set the cursor position at the end of the current line
-    setCursorPosition(cursorX, cursorY);
-}
-    // Function to check if the state has changed
+    // Replace [pos, pos + len) with text and record it for undo
+    void editText(size_t pos, size_t len, const string& text) {
+        string removed = buffer->substr(pos, pos + len);
+        if (removed == text) return;
+        recordEdit(pos, removed, text);
+        replaceText(pos, removed, text);
+    }
+
+    // Has the document changed since it was last written? O(1): the edit
+    // counter answers most of the time, and the rope's cached hash also
+    // recognises edits that were undone back to the saved text.
     bool isStateChanged() {
-        if (undoStack.empty()) return true; // If the undo stack is empty, consider it a change
+        if (buffer->version() == savedVersion) return false;
+        if (dynamic_cast<Rope*>(buffer.get()) && savedVersion != UINT64_MAX) {
+            return buffer->contentHash() != savedHash;
+        }
+        return true;
+    }
 
-        const auto& lastState = undoStack.back();
-        if (lastState.size() != lines.size()) return true; // If the number of lines is different
+    // Remember the document as it is now as the one on disk
+    void markSaved() {
+        savedVersion = buffer->version();
+        savedHash = dynamic_cast<Rope*>(buffer.get()) ? buffer->contentHash() : 0;
+    }
 
-        for (size_t i = 0; i < lines.size(); ++i) {
-            if (lines[i].size() != lastState[i].size()) return true; // Different line sizes
+    // Close the current command as one undo step, a new version in the history
+    void commitStep() {
+        if (pendingStep.edits.empty()) return;
+        pendingStep.cursorAfter = cursor;
+        pendingStep.statsAfter = stats;
+        unsentRecords += EditJournal::stepEnd(pendingStep.cursorBefore, pendingStep.cursorAfter);
+        history.add(move(pendingStep), dynamic_cast<Rope*>(buffer.get()));
+        pendingStep = UndoStep();
+    }
 
-            stack<char> temp1 = lines[i];
-            stack<char> temp2 = lastState[i];
-            while (!temp1.empty() && !temp2.empty()) {
-                if (temp1.top() != temp2.top()) return true; // Characters differ
-                temp1.pop();
-                temp2.pop();
-            }
+    // Insert text at the cursor and move the cursor past it
+    void insertText(const string& text) {
+        editText(cursor, 0, text);
+        cursor += text.size();
+    }
 
-            // If one stack is empty and the other is not, consider it a change
-            if (!temp1.empty() || !temp2.empty()) return true;
-        }
+    // Delete the character before the cursor, false at the start of the document
+    bool eraseBeforeCursor() {
+        if (cursor == 0) return false;
+        editText(cursor - 1, 1, "");
+        cursor--;
+        return true;
+    }
 
-        return false; // No changes detected
+    // Range of the cursor's line including its '\n', for cut and copy
+    void currentLineRange(size_t& from, size_t& to) {
+        from = buffer->lineStart(cursor);
+        to = buffer->lineEnd(cursor);
+        if (to < buffer->size()) to++;
     }
 
-    // Helper function to check if the character should be capitalized
-    bool shouldCapitalize() {
-        if (leftStack.empty()) return true;  // Capitalize at the start of a line
+    // Copy [from, to) to the clipboard. A rope document hands out a slice
+    // that shares its nodes, so even huge blocks copy in O(log n).
+    void copyRange(size_t from, size_t to) {
+        if (Rope* rope = dynamic_cast<Rope*>(buffer.get())) clipboard = rope->slice(from, to);
+        else clipboard = Rope(buffer->substr(from, to));
+    }
 
-        // Check if the last character before the cursor is a period, space, or newline
-        char lastChar = leftStack.top();
-        if (lastChar == '.' || lastChar == '\n' || isspace(lastChar)) return true;
+    // Ctrl+C: copy the current line
+    void copyLine() {
+        size_t from, to;
+        currentLineRange(from, to);
+        copyRange(from, to);
+    }
 
-        return false;
+    // Ctrl+X: cut the current line as one erase
+    void cutLine() {
+        size_t from, to;
+        currentLineRange(from, to);
+        copyRange(from, to);
+        editText(from, to - from, "");
+        cursor = from;
+        commitStep();
+        syncCursor();
+        updateTextFile();
     }
 
+    // Ctrl+V: paste the clipboard at the cursor as one insert
+    void paste() {
+        if (clipboard.size() == 0) return;
+        string text = clipboard.text();
+        recordEdit(cursor, "", text);
+        noteChange(cursor, 0, text);
+        countEdit(cursor, "", text);
+        journalEdit(cursor, "", text);
+        if (Rope* rope = dynamic_cast<Rope*>(buffer.get())) rope->insertRope(cursor, clipboard);
+        else buffer->insert(cursor, text);
+        cursor += text.size();
+        commitStep();
+        syncCursor();
+        updateTextFile();
+    }
 
-public:void updateTextFile() {
-    ofstream file(filename); // Use the member variable for the filename
-    for (const auto& lineStack : lines) {
-        // We need to output characters in the order they were added, so reverse the stack
-        std::stack<char> tempStack = lineStack;  // Make a copy of the current stack
-        std::stack<char> reverseStack;
+    // The word directly before the cursor (stops at a space or the line start)
+    string wordBeforeCursor() {
+        string word;
+        wordBeforeCursor(word);
+        return word;
+    }
 
-        // Reverse the stack to maintain original order of characters
-        while (!tempStack.empty()) {
-            reverseStack.push(tempStack.top());
-            tempStack.pop();
-        }
+    // The same into 'word', reusing its memory
+    void wordBeforeCursor(string& word) {
+        size_t end = cursor;
+        size_t start = end;
+        while (start > 0 && buffer->at(start - 1) != ' ' && buffer->at(start - 1) != '\n') start--;
+        word.clear();
+        buffer->forEachChunk(start, end, [&word](const char* data, size_t len) { word.append(data, len); });
+    }
 
-        // Write characters from the reversed stack into the file
-        while (!reverseStack.empty()) {
-            file << reverseStack.top();
-            reverseStack.pop();
+    
+// Start and end (before its '\n') of document line 'line'; false past the
+// last line
+bool lineRange(int line, size_t& from, size_t& to) {
+    size_t n = buffer->size();
+    from = buffer->lineOffset(line);
+    if (from == n && line > 0 && (n == 0 || buffer->at(n - 1) != '\n' || buffer->lineOffset(line - 1) == n)) return false;
+    to = buffer->lineOffset(line + 1);
+    if (to > from && buffer->at(to - 1) == '\n') to--;
+    return true;
+}
+
+// Draw document line 'line' into screen row 'row' of the next frame, only
+// the columns in view: text is read from the buffer for those columns alone,
+// so a very long line costs no more than a short one. The cursor's line also
+// shows the autocomplete suggestion and the cursor mark, which push the rest
+// of the line to the right.
+void drawRow(int row, int line) {
+    int color = *Colour_Itr;
+    screen.clearRow(row, color);
+    size_t from, to;
+    if (!lineRange(line, from, to)) return;
+    size_t left = view.left, right = view.left + view.width;
+    // Where the next chunk goes. The chunk callback only holds a reference
+    // to it, small enough for std::function to keep without allocating.
+    struct Pen {
+        ScreenBuffer& screen;
+        int row, col, color;
+    } pen = {screen, row, 0, color};
+    auto print = [&pen](const char* data, size_t len) { pen.col = pen.screen.put(pen.row, pen.col, data, len, pen.color); };
+    // Put [a, b) of the document, its first character in line column 'at'
+    auto text = [&](size_t a, size_t b, size_t at) {
+        size_t lo = max(at, left), hi = min(at + (b - a), right);
+        if (lo >= hi) return;
+        pen.col = lo - left;
+        buffer->forEachChunk(a + (lo - at), a + (hi - at), print);
+    };
+    // Put an overlay that is not part of the document at line column 'at'
+    auto overlay = [&](const char* str, size_t len, size_t at, int overlayColor) {
+        size_t lo = max(at, left), hi = min(at + len, right);
+        if (lo < hi) screen.put(row, lo - left, str + (lo - at), hi - lo, overlayColor);
+    };
+    if (line == cursorY) {
+        // Print the text before the cursor straight from the buffer's chunks
+        text(from, cursor, 0);
+        size_t at = cursor - from;
+
+        // Check for autocomplete suggestion
+        wordBeforeCursor(cursorWord);
+        auto found = autocompleteWords.find(cursorWord);
+        if (found != autocompleteWords.end()) {
+            // Display the suggestion in a different color, after an asterisk
+            overlay(" * ", 3, at, SUGGESTION_COLOR);
+            overlay(found->second.data(), found->second.size(), at + 3, SUGGESTION_COLOR);
+            at += 3 + found->second.size();
         }
-        file << '\n';
+
+        overlay("_", 1, at, color); // Cursor position
+        text(cursor, to, at + 1);
+    } else {
+        text(from, to, 0);
     }
-    // Add line gaps between the text and word count
-    for (int i = 0; i < 4; ++i) {
-        file << '\n';
+}
+
+// Helper function to display the current text
+void displayText() {
+    // Only the lines that fit on the screen are considered, scrolling so the
+    // cursor stays visible, and of those only the rows whose lines were edited
+    // (screenChanges) or that gain or lose the cursor mark are drawn again.
+    // Scrolling by less than a screen scrolls the console and draws just the
+    // lines that come into view. The screen buffer then writes the cells that
+    // differ from what is shown. Drawing costs the changed rows however long
+    // the document is, and a file that is still being indexed can be shown
+    // as soon as its first lines are known.
+    int rows, cols;
+    consoleSize(rows, cols);
+    view.height = max(1, rows - 1); // The last row is the status line
+    view.width = max(1, cols - 1);  // Writing the last column would wrap the row
+    view.follow(cursorY, cursorX);
+
+    bool all = screen.resize(rows, cols, *Colour_Itr) || !drawn || view.left != drawnView.left || view.height != drawnView.height;
+    int scrolled = view.top - drawnView.top;
+    if (!all && abs(scrolled) >= view.height) all = true;
+    if (!all && scrolled != 0) screen.scroll(0, view.height - 1, scrolled, *Colour_Itr);
+    for (int row = 0; row < view.height; row++) {
+        size_t line = view.top + row;
+        bool edited = screenChanges.any && line >= screenChanges.firstLine && line <= screenChanges.lastLine;
+        bool scrolledIn = scrolled > 0 ? row >= view.height - scrolled : row < -scrolled;
+        if (all || edited || scrolledIn || (int)line == cursorY || (int)line == drawnCursorLine) drawRow(row, line);
     }
-    // Write the live word count at the end of the file
-    file << "Current Word Count: " << word_count() << endl;
-    file.close();
+
+    // Statistics on the bottom row
+    const string& status = statusLine(cols - 1);
+    int statusRow = max(rows - 1, 1);
+    screen.clearRow(statusRow, *Colour_Itr);
+    screen.put(statusRow, 0, status.data(), status.size(), *Colour_Itr);
+    screenChanges.clear();
+    drawnCursor = cursor;
+    drawnView = view;
+    drawn = true;
+    drawnCursorLine = cursorY;
+
+    // Set the cursor position at the end of the current line
+    screen.present(cursorY - view.top, cursorX - view.left);
 }
-    TextEditor() {
+    // Bring the capitalization state to the cursor. Typing carries it along;
+    // after any other edit or a cursor move it is read again from the text
+    // before the cursor.
+    void syncCapitals() {
+        if (capitalsAt == cursor && capitalsVersion == buffer->version()) return;
+        capitals = Capitalizer(Capitalizer::stateAt(*buffer, cursor));
+        capitalsAt = cursor;
+        capitalsVersion = buffer->version();
+    }
+
+    // Helper function to check if the character should be capitalized
+    bool shouldCapitalize() {
+        syncCapitals();
+        return capitals.capitalizesNext();
+    }
+
+
+    // Have the whole document written with its word count footer, which also
+    // folds the journal into the file. The saver gets a cheap snapshot and
+    // reads the text out of it on its own thread.
+    void saveDocument() {
+        if (!isStateChanged() && journalBytes == 0 && unsentRecords.empty()) return; // Nothing new to write
+        SaveJob* job = new SaveJob();
+        job->snapshot = buffer->snapshot();
+        job->dirtyFrom = fileChanges.firstByte;
+        // A piece table maps the file: it may only be patched where nothing
+        // reads the mapping any more (the opened file's count reads all of it)
+        PieceTable* pieces = dynamic_cast<PieceTable*>(buffer.get());
+        job->inPlace = !pieces || (!countingDocument() && pieces->originalUnusedFrom(job->dirtyFrom));
+        job->words = word_count();
+        if (countingDocument()) job->openedStats = openedStats; // Not counted yet: the saver waits for it
+        fileChanges.clear();
+        job->covered.swap(unsentRecords);
+        journalBytes = 0;
+        markSaved();
+        saver.submit(job);
+    }
+
+public:
+    // Called after every key press: hands the new journal records to the
+    // saver, which writes them within DEFAULT_SAVE_INTERVAL_MS. Once the
+    // journal has grown past JOURNAL_COMPACT_BYTES it is compacted into a
+    // full rewrite instead.
+    void updateTextFile() {
+        if (journalBytes + unsentRecords.size() >= JOURNAL_COMPACT_BYTES) {
+            saveDocument();
+        } else if (!unsentRecords.empty()) {
+            SaveJob* job = new SaveJob();
+            job->records.swap(unsentRecords);
+            journalBytes += job->records.size();
+            saver.submit(job);
+        }
+    }
+
+    // New document, stored in a rope unless options.engine says otherwise
+    TextEditor(const EditorOptions& options = EditorOptions()) {
     // Initially start with one empty line
-    lines.push_back(stack<char>());
-    undoStack.push_back(lines); // Initialize undo stack with the initial state
+    buffer.reset(makeBuffer(options.engine.empty() ? "rope" : options.engine));
+    history.setBudget(options.undoBudget);
+    history.reset(dynamic_cast<Rope*>(buffer.get()));
 
     // Determine the filename
     filename = "myDoc.txt"; // Initialize with the default filename
@@ -407,70 +3995,76 @@ public:void updateTextFile() {
     ofstream file(filename);
     file.close(); // Close the file after creating it
 
+    saver.start(filename, options.saveInterval, options.fsyncPolicy);
     SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), *Colour_Itr);  // Set initial colour attribute to default
-    updateTextFile(); // Update the text file with initial content
+    saveDocument(); // Write the initial content
 }
 
-void insert_capital_i(stack<char>& stack) {
-    vector<char> temp; //a temporary vector of three charecters to observe " i "/" i.?!"
-    
-    // Retrieve the last three characters from the stack
-    if(stack.size()>=3){
-        for(int i=0;i<3;i++){
-            temp.push_back(stack.top());
-            stack.pop();
-        }
-        // Check if we have " i " pattern
-        if (temp[2] == ' ' && temp[1] == 'i' && (temp[0] == ' ' || temp[0] == '.' || temp[0] == '?' || temp[0] == '!')) {
-            temp[1] = 'I';  // Capitalize 'i'
-        }
-
-        // Push the characters back to the stack in reverse order
-        for (int i = 2; i >= 0; i--) {
-            stack.push(temp[i]);
-        }
-    } else {
-        // Push characters back if we didn’t find the pattern or stack size is less than 3
-        for (auto it = temp.rbegin(); it != temp.rend(); ++it) {
-            stack.push(*it);
+    // Open an existing document. With the "piece" engine (the default here) the
+    // file is memory-mapped into a piece table, so this does not read or
+    // rewrite the file whatever its size; the other engines read it in with
+    // readWholeFile(). If a session did not exit cleanly, its journal is
+    // replayed on top (see recoverJournal()) and kept for further edits.
+    TextEditor(const string& path, const EditorOptions& options) {
+    filename = path;
+    string engine = options.engine.empty() ? "piece" : options.engine;
+    remove((filename + ".tmp").c_str()); // Left by an interrupted save; the document itself is intact
+    EditJournal::redoCheckpoint(filename + ".journal", filename); // Finish an interrupted patch
+    string data;
+    if (engine == "piece") {
+        unique_ptr<PieceTable> document(new PieceTable());
+        if (document->open(filename)) {
+            openedStats = async(launch::async, statsOfParallel, document->originalText(), document->originalSize(), 0u).share();
+            buffer = move(document);
         }
+    } else if (readWholeFile(filename, data)) {
+        data.resize(documentLength(data.data(), data.size()));
+        stats = statsOf(data.data(), data.size());
+        buffer.reset(makeBuffer(engine));
+        buffer->insert(0, data);
+    }
+    if (!buffer) {
+        // No such file yet: start an empty document under that name
+        buffer.reset(makeBuffer(engine));
+        ofstream file(filename);
+        file.close();
+    }
+    markSaved(); // The file on disk already holds this text
+    history.setBudget(options.undoBudget);
+    history.reset(dynamic_cast<Rope*>(buffer.get()));
+    history.get(history.currentId()).step.statsAfter = stats;
+    size_t journalLength = recoverJournal();
+    bool resumed = journalLength > EditJournal::HEADER_SIZE && saver.resumeJournal(filename, journalLength);
+    if (resumed) journalBytes = journalLength - EditJournal::HEADER_SIZE;
+    saver.start(filename, options.saveInterval, options.fsyncPolicy);
+    if (journalLength > EditJournal::HEADER_SIZE && !resumed) {
+        fileChanges.addAll(); // The journal could not be kept: write the recovered text
+        saveDocument();
     }
+
+    SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), *Colour_Itr);  // Set initial colour attribute to default
+}
+
+void insert_capital_i() {
+    // The character just typed ended a lone "i": capitalize it in place
+    editText(cursor - 2, 1, "I");
 }
 
 
     // Insert a character at the current cursor position with auto-capitalization
     void insert_capital(char ch) {
-        // Capitalize if it's the first character being inserted or follows punctuation
-        bool caps = false; 
-        if (leftStack.empty()) {
-            caps = true;  // Capitalize the first character, matlab its the first charecter.
-        } else {
-            // Create a temporary stack to check the previous characters
-            stack<char> tempStack = leftStack;
-            char lastChar = tempStack.top();
-            tempStack.pop();
-
-            // Check if the last character is punctuation that should trigger capitalization
-            if (lastChar == '\n' || lastChar == '.' || lastChar == '?' || lastChar == '!') {
-                caps = true;
-            } else if (lastChar == ' ' && !tempStack.empty()) {
-                // Check if a period, question mark, or exclamation mark precedes a space
-                char secondLastChar = tempStack.top();
-                if (secondLastChar == '.' || secondLastChar == '?' || secondLastChar == '!') {
-                    caps = true;
-                }
-            }
-        }
-        leftStack.push(caps ? toupper(ch) : ch);
-        insert_capital_i(leftStack);
+        // Capitalize if it starts a sentence, and fix a lone "i" it ends
+        syncCapitals();
+        bool fixI = false;
+        char typed = capitals.feed(ch, fixI);
+        insertText(string(1, typed));
+        if (fixI) insert_capital_i();
+        capitalsAt = cursor;
+        capitalsVersion = buffer->version();
 
-        // Update the states
-        lines[currentLine] = leftStack;
-        redoStack.clear(); // Clear the redo stack when a new character is inserted
-
-        if (isStateChanged()) {
-            undoStack.push_back(lines); // Push to the undo stack if the state has changed
-        }
+        // Record the key press (character plus any capitalization) as one undo step
+        commitStep();
+        syncCursor();
 
         updateTextFile();
 }
@@ -478,174 +4072,263 @@ void insert_capital_i(stack<char>& stack) {
 
 
 
-    // Move the cursor to the left
+    // Move the cursor to the left (stays on the current line)
     void moveCursorLeft() {
-        if (!leftStack.empty()) {
-            rightStack.push(leftStack.top());
-            leftStack.pop();
-            lines[currentLine] = leftStack;
+        size_t pos = cursor;
+        if (pos > 0 && buffer->at(pos - 1) != '\n') {
+            cursor = pos - 1;
         }
+        syncCursor();
     }
 
-    // Move the cursor to the right
+    // Move the cursor to the right (stays on the current line)
     void moveCursorRight() {
-        if (!rightStack.empty()) {
-            leftStack.push(rightStack.top());
-            rightStack.pop();
-            lines[currentLine] = leftStack;
+        size_t pos = cursor;
+        if (pos < buffer->size() && buffer->at(pos) != '\n') {
+            cursor = pos + 1;
         }
+        syncCursor();
+    }
+
+    // True if there is no text between the cursor and the end of its line
+    bool atLineEnd() {
+        size_t pos = cursor;
+        return pos == buffer->size() || buffer->at(pos) == '\n';
     }
 
     // Move the cursor up
 void moveCursorUp() {
-    if (currentLine > 0) {
-        // Store the current line state before moving up
-        lines[currentLine] = leftStack;    
-        currentLine--;                     // Move to the previous line
-        leftStack = lines[currentLine];    // Load the previous line's leftStack
-        rightStack = stack<char>();        // Clear the rightStack (cursor at end of previous line)
-        cursorX = leftStack.size();        // Move the cursor to the end of the previous line
+    size_t start = buffer->lineStart(cursor);
+    if (start > 0) {
+        cursor = start - 1;         // End of the previous line
     }
-    displayText(); // Refresh the display after moving the cursor
-    setCursorPosition(cursorX, cursorY); // Update cursor position
+    syncCursor();
+    displayText(); // Refresh the display after moving the cursor (and place the cursor)
 }
 
     // Move the cursor down
     void moveCursorDown() {
-        if (currentLine < lines.size() - 1) {
-            lines[currentLine] = leftStack;    // Store current line state
-            currentLine++;                     // Move to the next line
-            leftStack = lines[currentLine];    // Load the next line's leftStack
-            rightStack = stack<char>();        // Clear rightStack
-            cursorY++;                         // Update cursor Y position
-            cursorX = leftStack.size();        // Move the cursor to the end of the next line
+        size_t end = buffer->lineEnd(cursor);
+        if (end < buffer->size()) {
+            cursor = buffer->lineEnd(end + 1); // End of the next line
         }
+        syncCursor();
     }
 
-    // Backspace (delete character before the cursor)
+    // Backspace (delete character before the cursor, joining lines at the line start)
     void backspace() {
-        if (!leftStack.empty()) {
-            leftStack.pop();
-            lines[currentLine] = leftStack;
-
-            if (isStateChanged()) {
-                undoStack.push_back(lines); // Push only if the state has changed
-                // Limit the undo stack size
-                if (undoStack.size() > MAX_UNDO_SIZE) {
-                    undoStack.erase(undoStack.begin()); // Remove the oldest state if limit exceeded
-                }
-            }
-
-            cursorX = max(cursorX - 1, 0);
-        } else if (currentLine > 0) {
-            cursorX = lines[currentLine - 1].size();  // Move cursor to the end of the previous line
-            stack<char> previousLine = lines[currentLine - 1];
-            while (!rightStack.empty()) {
-                previousLine.push(rightStack.top());
-                rightStack.pop();
-            }
-            lines[currentLine - 1] = previousLine;    // Merge the current line's rightStack with the previous line
-            lines.erase(lines.begin() + currentLine); // Remove the current empty line
-            currentLine--;                            // Move to the previous line
-            leftStack = lines[currentLine];           // Load the left stack of the previous line
-        }
+        eraseBeforeCursor();
+        commitStep();
+        syncCursor();
         updateTextFile();
     }
 
     // Delete (delete character after the cursor)
     void deleteChar() {
-        if (!rightStack.empty()) {
-            rightStack.pop();
-            redoStack.clear(); // Clear the redo stack when delete is used
+        if (!atLineEnd()) {
+            editText(cursor, 1, "");
+            commitStep();
         }
         updateTextFile();
     }
 
     // Insert a newline, capitalize that charecter
     void insertCapitalNewLine() {
-    lines[currentLine] = leftStack;   // Store current line's state
-    redoStack.clear(); // Clear the redo stack when a new line is inserted
-    currentLine++;                    // Move to the next line
-    if (currentLine >= lines.size()) {
-        lines.push_back(stack<char>()); // Create a new line if necessary
+    insert_capital('\n');             // Split the line at the cursor; the next letter is capitalized
+}
+
+    // The edits that lead from the current version to 'target': the inverse
+    // of each step up to the common ancestor (newest first), then the steps
+    // down to the target in their original order
+    vector<Edit> pathTo(int target) {
+        vector<Edit> path;
+        int from = history.currentId();
+        int to = target;
+        vector<int> down;
+        while (from != to) {
+            if (history.get(from).depth >= history.get(to).depth) {
+                const vector<Edit>& edits = history.get(from).step.edits;
+                for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+                    path.push_back({it->pos, it->inserted, it->removed});
+                }
+                from = history.parentOf(from);
+            } else {
+                down.push_back(to);
+                to = history.parentOf(to);
+            }
+        }
+        for (auto it = down.rbegin(); it != down.rend(); ++it) {
+            for (const Edit& e : history.get(*it).step.edits) path.push_back(e);
+        }
+        return path;
     }
-    leftStack = stack<char>();        // Clear left stack for the new line
-    rightStack = stack<char>();       // Clear right stack
-    cursorX = 0;                      // Reset cursor position
-    cursorY++;                        // Move cursor to the next line
 
-    updateTextFile();
-}
+    // Make 'target' the current version. A rope document just takes the
+    // version's snapshot (the journal still gets the edits in between);
+    // other engines replay those edits, so the cost is their size.
+    void jumpTo(int target) {
+        vector<Edit> path = pathTo(target);
+        Rope* rope = dynamic_cast<Rope*>(buffer.get());
+        if (rope && history.get(target).hasSnapshot) {
+            for (const Edit& e : path) {
+                journalEdit(e.pos, e.removed, e.inserted);
+                fileChanges.add(e.pos, 0, true);
+            }
+            rope->assign(history.get(target).snapshot);
+            stats = history.get(target).step.statsAfter;
+            screenChanges.addAll();
+        } else {
+            for (const Edit& e : path) replaceText(e.pos, e.removed, e.inserted);
+        }
+        history.setCurrent(target);
+        cursor = min(history.get(target).step.cursorAfter, buffer->size());
+    }
 
+    // Go to another version: 'U' the parent (undo), 'R' the child redo goes
+    // to, 'B' the next sibling (Ctrl+B). The move is journaled after the edits
+    // that take the text there. During recovery the journal has already
+    // brought the text there, so only the history moves (moveText false).
+    // False if there is no such version.
+    bool moveInHistory(char move, bool moveText) {
+        int current = history.currentId();
+        int parent = history.parentOf(current);
+        int target = -1;
+        if (move == 'U') {
+            target = parent;
+        } else if (move == 'R') {
+            target = history.get(current).redoChild;
+        } else if (parent != -1) {
+            const vector<int>& siblings = history.get(parent).children;
+            size_t i = find(siblings.begin(), siblings.end(), current) - siblings.begin();
+            target = siblings[(i + 1) % siblings.size()];
+        }
+        if (target == -1 || target == current || !history.contains(target)) return false;
 
-    void undo() {
-        if (undoStack.size() > 1) { // Check if there's an undo state available
-            redoStack.push_back(lines);  // Store current state in redo before undoing
-            undoStack.pop_back();        // Remove the current state
-            lines = undoStack.back();    // Restore the previous state
-            if (currentLine >= lines.size()) currentLine = lines.size() - 1;
-            leftStack = lines[currentLine];
-            rightStack = stack<char>();  // Clear the rightStack after undo
+        if (moveText) {
+            jumpTo(target);
+            unsentRecords += EditJournal::historyMove(move);
+        } else {
+            history.setCurrent(target);
+            cursor = min(history.get(target).step.cursorAfter, buffer->size());
+        }
+        if (move == 'U') {
+            history.get(parent).redoChild = current; // Redo comes back here
+            cursor = history.get(current).step.cursorBefore;
+        } else if (move == 'B') {
+            history.get(parent).redoChild = target;
         }
+        return true;
+    }
+
+    void undo() {
+        if (moveInHistory('U', true)) syncCursor(); // Check if there's an older version available
         updateTextFile();
     }
 
     void redo() {
-        if (!redoStack.empty()) {
-            undoStack.push_back(lines);   // Save current state to undo stack
-            lines = redoStack.back();     // Restore the redo state
-            redoStack.pop_back();         // Remove the redo state
-            if (currentLine >= lines.size()) currentLine = lines.size() - 1;
-            leftStack = lines[currentLine];
-            rightStack = stack<char>();  // Clear rightStack after redo
-        }
+        if (moveInHistory('R', true)) syncCursor();
         updateTextFile();
     }
 
+    // Ctrl+B: switch to the next branch, i.e. the next sibling of the current version
+    void switchBranch() {
+        if (!moveInHistory('B', true)) return;
+        syncCursor();
+        updateTextFile();
+    }
 
-     long long int word_count() {
-    long long int count = 0; // Set initial count to 0
-    string all_lines = ""; // Create a string to store all the data so far
+    // Rebuild the text, the undo history and the cursor from the journal of a
+    // session that did not exit cleanly. Edits go into the buffer and steps
+    // into the history as they did when typed, so this costs O(journal),
+    // whatever the document's size. History from before the last full save
+    // is not in the journal; undo stops at the document as it is on disk.
+    // Returns the length of the intact part of the journal, 0 if there is none.
+    size_t recoverJournal() {
+        UndoStep step;
+        size_t length = EditJournal::replay(filename + ".journal", filename, *buffer,
+            [&](char type, uint64_t pos, const string& removed, const string& inserted) {
+                if (type == 'E') {
+                    stats += statsChange(*buffer, pos, inserted.size(), removed, inserted); // Already applied
+                    if (step.edits.empty()) step.cursorBefore = cursor;
+                    step.edits.push_back({(size_t)pos, removed, inserted});
+                    fileChanges.add(pos, 0, true); // The file does not have it
+                    cursor = pos + inserted.size();
+                } else if (type == 'S') {
+                    step.cursorBefore = pos;
+                    step.cursorAfter = cursor = EditJournal::getU64(inserted, 0);
+                    step.statsAfter = stats;
+                    history.add(move(step), dynamic_cast<Rope*>(buffer.get()));
+                    step = UndoStep();
+                } else if (moveInHistory(type, false)) {
+                    step = UndoStep(); // Those edits only took the text to the other version
+                } else if (!step.edits.empty()) {
+                    // The version it went to was from before the last full
+                    // save and is not in the history: the edits are in the
+                    // text, so keep them as an ordinary step on top
+                    step.cursorAfter = cursor;
+                    step.statsAfter = stats;
+                    history.add(move(step), dynamic_cast<Rope*>(buffer.get()));
+                    step = UndoStep();
+                }
+            });
+        pendingStep = move(step); // A command the crash cut short
+        cursor = min(cursor, buffer->size());
+        syncCursor();
+        return length;
+    }
 
-    // Traverse through lines to get all data in one string
-    for (const auto& lineStack : lines) {
-        stack<char> tempStack = lineStack;
-        stack<char> reversedStack;
 
-        // Reverse the stack to maintain original order of characters
-        while (!tempStack.empty()) {
-            reversedStack.push(tempStack.top());
-            tempStack.pop();
+    // Statistics of the whole document, O(1): they are kept up to date by
+    // every edit (an opened file's own text is counted once). Never waits:
+    // while the opened file is still being counted its text is left out.
+    TextStats documentStats() {
+        if (openedStats.valid() && !countingDocument()) {
+            openedTextStats = openedStats.get();
+            openedStats = shared_future<TextStats>();
         }
+        TextStats all = openedTextStats;
+        all += stats;
+        return all;
+    }
 
-        // Write characters from the reversed stack into the all_lines string
-        while (!reversedStack.empty()) {
-            all_lines += reversedStack.top();
-            reversedStack.pop();
-        }
-        all_lines += '\n'; // Add a newline character after each line
+    // Is an opened file still being counted?
+    bool countingDocument() {
+        return openedStats.valid() && openedStats.wait_for(chrono::seconds(0)) != future_status::ready;
     }
 
-    // Use istringstream to count words
-    istringstream stream(all_lines);
-    string word;
-    while (stream >> word) count++; // Count words
+    // One line with the statistics, at most 'width' characters
+    // (kept in statusText, so drawing a frame does not allocate)
+    const string& statusLine(int width) {
+        string& line = statusText;
+        if (countingDocument()) {
+            line = "Counting...";
+        } else {
+            TextStats all = documentStats();
+            char text[256];
+            snprintf(text, sizeof(text),
+                     "Words %lld  Chars %lld (%lld non-space)  Lines %lld  Sent. %lld  Para. %lld  Avg %.1f  Flesch %.0f",
+                     all.words, all.chars, all.nonSpace, all.lines(), all.sentences, all.paragraphs,
+                     all.averageWordLength(), all.readability());
+            line = text;
+        }
+        if ((int)line.size() > width) line.resize(max(width, 0));
+        return line;
+    }
 
-    return count;
+     long long int word_count() {
+    return documentStats().words; // Whitespace separated words
 }
 
 
     void setTextColor(int color)
     {
-       SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color);  //Set text colour to given colour
+       screen.setAttribute(color);  //Set text colour to given colour
     }
 
     // Main function to handle real-time editing
     // Main function to handle real-time editing
 void runEditor() {
-    system("cls");
-    displayText();
-    setCursorPosition(cursorX, cursorY);
+    displayText(); // The first frame clears the screen
 
     while (true) {
         if (_kbhit()) {  // Checks if the keyboard gave a signal
@@ -657,12 +4340,14 @@ void runEditor() {
                 switch (ch) {
                     case 75: // Left arrow key
                         moveCursorLeft();
-                        cursorX = max(cursorX - 1, 0);
                         break;
                     case 77: // Right arrow key
-                        moveCursorRight();
-                        cursorX++;
-                        if(rightStack.empty()) leftStack.push(' ');
+                        if (atLineEnd()) {
+                            insertText(" ");  // Extend the line past its end
+                            commitStep();
+                        }
+                        else moveCursorRight();
+                        syncCursor();
                         break;
                     case 72: // Up arrow key
                         moveCursorUp();
@@ -687,11 +4372,25 @@ void runEditor() {
             else if (ch == 25) {  // Ctrl + Y (Redo)
                 redo();
             }
+            else if (ch == 2) {   // Ctrl + B (Switch undo branch)
+                switchBranch();
+            }
+            else if (ch == 24) {  // Ctrl + X (Cut line)
+                cutLine();
+            }
+            else if (ch == 3) {   // Ctrl + C (Copy line)
+                copyLine();
+            }
+            else if (ch == 22) {  // Ctrl + V (Paste)
+                paste();
+            }
             // else if (ch == 19) {  // Ctrl + S (Save)
             //     save();
             // }
             else if (ch == 27) {  // ESC key to exit
                 SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), Colours[0]);   //Revert to original colour
+                saveDocument(); // Fold the journal into the document before leaving
+                saver.finish(); // Wait for the last writes
                 break;
             }
             else if (ch==18)    //Ctrl + R (Change Colour)
@@ -699,91 +4398,191 @@ void runEditor() {
                 Colour_Itr++;   //Move to next colour in the palette
                 if(Colour_Itr==Colours.end()) Colour_Itr = Colours.begin();
                 setTextColor(*Colour_Itr);      //Set colour to next colour
+                screenChanges.addAll();         //Every row is printed again in the new colour
                 displayText();
-                setCursorPosition(cursorX, cursorY);
                 continue;
             }
             else if(ch == 32){//Space for autocorrect
-                string str = "";
-                stack<char> temp = leftStack;
-
                 // Collect characters until the last space (or the beginning of the line)
-                while (!temp.empty() && temp.top() != ' ') {
-                    str += temp.top(); // Append each character to str
-                    temp.pop();
-                    }
-                // Reverse the extracted string to get the actual word
-                reverse(str.begin(), str.end());
+                string str = wordBeforeCursor();
                 transform(str.begin(), str.end(), str.begin(), ::tolower);
-                spellcheckAndSuggest(trie, str, "C:/Users/sohom/Downloads/DSA-Group-3-main/DSA-Group-3-main/Primary Implementations/suggestions.txt");
-                leftStack.push(' ');
-                cursorX++;
+                waitForDictionary();
+                string report = spellcheckAndSuggest(trie, str);
+                if (!report.empty()) { // The saver appends it to SUGGESTIONS_FILE
+                    SaveJob* job = new SaveJob();
+                    job->suggestions = report;
+                    saver.submit(job);
+                }
+                insert_capital(' ');
             } 
 
             else if (ch == 9) { // TAB key for autocomplete
-    string str = "";
-    stack<char> temp = leftStack;
-
     // Collect characters until the last space (or the beginning of the line)
-    while (!temp.empty() && temp.top() != ' ') {
-        str += temp.top(); // Append each character to str
-        temp.pop();
-    }
-
-    // Reverse the extracted string to get the actual word
-    reverse(str.begin(), str.end());
+    string str = wordBeforeCursor();
 
     // Check if the word exists in the hashmap
     if (autocompleteWords.find(str) != autocompleteWords.end()) {
         string suggestion = autocompleteWords[str];
 
-        // Preserve the current right stack
-        stack<char> tempRightStack = rightStack;
-
-        // Remove the extracted word from leftStack
-        for (int i = 0; i < str.size(); ++i) {
-            leftStack.pop();
-        }
-
-        // Insert the suggestion into leftStack
-        for (char c : suggestion) {
-            leftStack.push(c);
-        }
+        // Replace the extracted word with the suggestion in one operation
+        editText(cursor - str.size(), str.size(), suggestion);
+        cursor += suggestion.size() - str.size();
+        commitStep();
 
         // Update cursor position
-        cursorX = leftStack.size(); // Move cursor to the end of the newly inserted suggestion
-
-        // Restore the right stack
-        rightStack = tempRightStack;
-
-        lines[currentLine] = leftStack; // Update the current line
+        syncCursor(); // Move cursor to the end of the newly inserted suggestion
         
         // Set text color to the current color before displaying text
         setTextColor(*Colour_Itr);
         
         displayText();
         updateTextFile();
-        setCursorPosition(cursorX, cursorY);
     }
 }
 
 
             else {  // Regular character input
                 insert_capital(ch);
-                cursorX++;
             }
 
-            displayText();
+            if (screenChanges.any || cursor != drawnCursor) displayText(); // Skip redrawing an unchanged screen
             updateTextFile();
-            setCursorPosition(cursorX, cursorY);
         }
     }
 }
 };
 
-int main() {
-    loadDictionary(trie, "C:/Users/sohom/Downloads/DSA-Group-3-main/DSA-Group-3-main/Primary Implementations/dictionary.txt");  // Load words from dictionary.txt
-    TextEditor editor;
-    editor.runEditor();
+//I/O benchmark starts
+// --bench-io[=MB]: write and read back an MB sized file, once through the
+// synchronous ofstream/ifstream path and once through OutputFile and
+// readWholeFile() (io_uring or the thread fallback). Writes go in 512 byte
+// pieces, the way a save walks the leaves of a rope.
+void runIoBenchmark(size_t megabytes) {
+    string data;
+    data.reserve(megabytes << 20);
+    for (size_t line = 0; data.size() < (megabytes << 20); line++) {
+        data += "Line " + to_string(line) + " of the I/O benchmark text.\n";
+    }
+    string path = "io_bench.tmp";
+    auto timed = [](const function<void()>& fn) {
+        auto start = chrono::steady_clock::now();
+        fn();
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    string back;
+    double streamWrite = timed([&] {
+        ofstream out(path, ios::binary);
+        for (size_t i = 0; i < data.size(); i += 512) out.write(data.data() + i, min<size_t>(512, data.size() - i));
+    });
+    double streamRead = timed([&] {
+        ifstream in(path, ios::binary);
+        back.assign(data.size(), '\0');
+        in.read(&back[0], back.size());
+    });
+    bool streamOk = back == data;
+    remove(path.c_str()); // Both writes start from a new file
+    double asyncWrite = timed([&] {
+        OutputFile out;
+        out.open(path, false);
+        for (size_t i = 0; i < data.size(); i += 512) out.write(data.data() + i, min<size_t>(512, data.size() - i));
+        out.close();
+    });
+    double asyncRead = timed([&] { readWholeFile(path, back); });
+    bool asyncOk = back == data;
+    remove(path.c_str());
+
+#ifdef _WIN32
+    string backend = "synchronous Win32 calls";
+#else
+    string backend = AsyncIO().usesRing() ? "io_uring" : "threads with pread/pwrite";
+#endif
+    double mb = data.size() / 1048576.0;
+    cout << "I/O benchmark, " << mb << " MB, backend: " << backend << "\n";
+    cout << "  ofstream write   " << streamWrite << " ms (" << mb * 1000 / streamWrite << " MB/s)\n";
+    cout << "  ifstream read    " << streamRead << " ms (" << mb * 1000 / streamRead << " MB/s)" << (streamOk ? "" : " MISMATCH") << "\n";
+    cout << "  OutputFile write " << asyncWrite << " ms (" << mb * 1000 / asyncWrite << " MB/s)\n";
+    cout << "  readWholeFile    " << asyncRead << " ms (" << mb * 1000 / asyncRead << " MB/s)" << (asyncOk ? "" : " MISMATCH") << "\n";
+}
+//I/O benchmark ends
+
+//Batch capitalization starts
+// --capitalize: apply the auto-capitalization rules to existing files, so
+// imported text ends up exactly as if it had been typed into the editor.
+// Files are memory-mapped, capitalized on all cores and replaced through a
+// temporary file, like a save. Files that need no change are not written.
+int runCapitalize(const vector<string>& files) {
+    int status = 0;
+    for (const string& file : files) {
+        if (ifstream(file + ".journal")) { // Its edits would no longer match the text
+            cerr << "capitalize: " << file << " has unsaved edits; open it in the editor first" << endl;
+            status = 1;
+            continue;
+        }
+        MappedFile mapped;
+        if (!mapped.open(file)) {
+            cerr << "capitalize: cannot open " << file << endl;
+            status = 1;
+            continue;
+        }
+        auto start = chrono::steady_clock::now();
+        string out(mapped.size(), '\0');
+        capitalizeParallel(mapped.data(), &out[0], out.size());
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        size_t changed = 0;
+        for (size_t i = 0; i < out.size(); i++) changed += out[i] != mapped.data()[i];
+        mapped.close();
+        if (changed > 0) {
+            string tempName = file + ".tmp";
+            OutputFile output;
+            bool ok = output.open(tempName, false) && output.write(out) && output.sync();
+            ok = output.close() && ok;
+            if (!ok || !replaceFile(tempName, file)) { // The original stays as it was
+                cerr << "capitalize: cannot write " << tempName << endl;
+                remove(tempName.c_str());
+                status = 1;
+                continue;
+            }
+            syncDirectory(file);
+        }
+        printf("%s: %zu letters capitalized (%.1f MB/s)\n", file.c_str(), changed,
+               out.size() / 1048576.0 / max(ms, 0.001) * 1000);
+    }
+    return status;
+}
+//Batch capitalization ends
+
+int main(int argc, char* argv[]) {
+    string path = "";
+    EditorOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--wc") { // Count the files that follow instead of editing
+            return runWordCount(vector<string>(argv + i + 1, argv + argc));
+        }
+        if (arg == "--capitalize") { // Capitalize the files that follow instead of editing
+            return runCapitalize(vector<string>(argv + i + 1, argv + argc));
+        }
+        if (arg.rfind("--bench-io", 0) == 0) { // Benchmark file I/O instead of editing
+            runIoBenchmark(arg.size() > 11 ? stoull(arg.substr(11)) : 256);
+            return 0;
+        }
+        else if (arg.rfind("--engine=", 0) == 0) options.engine = arg.substr(9); // gap, piece or rope
+        else if (arg.rfind("--undo-budget=", 0) == 0) options.undoBudget = stoull(arg.substr(14)); // Bytes of undo history
+        else if (arg.rfind("--save-interval=", 0) == 0) options.saveInterval = stoi(arg.substr(16)); // Milliseconds between background writes
+        else if (arg.rfind("--fsync=", 0) == 0) { // idle, exit or a number of seconds
+            string policy = arg.substr(8);
+            options.fsyncPolicy = policy == "idle" ? FSYNC_ON_IDLE : policy == "exit" ? FSYNC_ON_EXIT : max(1, stoi(policy));
+        }
+        else path = arg;
+    }
+    loadDictionaryInBackground("C:/Users/sohom/Downloads/DSA-Group-3-main/DSA-Group-3-main/Primary Implementations/dictionary.txt");  // Load words from dictionary.txt
+    if (!path.empty()) {
+        TextEditor editor(path, options); // Open (or create) the given document
+        editor.runEditor();
+    } else {
+        TextEditor editor(options);
+        editor.runEditor();
+    }
+    waitForDictionary();
     return 0;
 }